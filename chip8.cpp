@@ -1,24 +1,155 @@
 #include "chip8.h"
-#include "chip8gfx.h"
+#include "chip8frame.h"
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <ctime>
-#include <sstream>
-#include <unordered_map>
-#include "chip8audio.h"
+#include <algorithm>
+#include <cstdint>
+#include "chip8disasm.h"
+#include "logger.h"
 
+namespace
+{
 
-Chip8::Chip8()
+// A sprite row as 8 pixel bytes of 0/1 in display order, so DXYN XORs a
+// whole row into gfx with one 64-bit operation per plane
+struct SpriteRows
+{
+    uint64_t row[256];
+
+    SpriteRows()
+    {
+        for (int bits = 0; bits < 256; ++bits)
+        {
+            unsigned char pixels[8];
+            for (int p = 0; p < 8; ++p) pixels[p] = (bits & (0x80 >> p)) ? 1 : 0;
+            memcpy(&row[bits], pixels, 8);
+        }
+    }
+};
+
+const SpriteRows SPRITE_ROWS;
+
+} // namespace
+
+
+Chip8Timing Chip8Timing::flat(unsigned int instructionsPerSecond)
+{
+    Chip8Timing t;
+    t.clockRate = instructionsPerSecond ? instructionsPerSecond : 1;
+    for (int i = 0; i < 16; ++i) t.cost[i] = 1;
+    t.displayWait = false;
+    return t;
+}
+
+Chip8Timing Chip8Timing::vip()
+{
+    // averages over each group, skips and FX33/FX55/FX65 vary with their operands on the real thing
+    static const unsigned short VIP_COST[16] =
+    {
+        24,  // 00E0 00EE
+        12,  // 1NNN
+        26,  // 2NNN
+        14,  // 3XNN
+        14,  // 4XNN
+        18,  // 5XY0
+        6,   // 6XNN
+        10,  // 7XNN
+        44,  // 8XYN
+        18,  // 9XY0
+        12,  // ANNN
+        22,  // BNNN
+        36,  // CXNN
+        170, // DXYN, a few rows of shifting and XORing
+        18,  // EX9E EXA1
+        40   // FXNN
+    };
+    Chip8Timing t;
+    t.clockRate = 3668 * 60;
+    memcpy(t.cost, VIP_COST, sizeof(t.cost));
+    t.displayWait = true;
+    return t;
+}
+
+Chip8Timing Chip8Timing::withCyclesPerFrame(unsigned int cycles) const
 {
-    enableLogging();
+    Chip8Timing t = *this;
+    t.clockRate = (cycles ? cycles : 1) * 60;
+    return t;
+}
+
+namespace
+{
+
+// parse/name order, bit n of Chip8Quirks::index()
+const char *const QUIRK_NAMES[] = {"inc-i", "shift-vy", "vf-reset", "wrap"};
+
+} // namespace
+
+int Chip8Quirks::index() const
+{
+    return (loadStoreIncrementsI ? 1 : 0) | (shiftReadsVY ? 2 : 0) | (logicResetsVF ? 4 : 0) | (wrapSprites ? 8 : 0);
+}
+
+Chip8Quirks Chip8Quirks::fromIndex(int index)
+{
+    Chip8Quirks q;
+    q.loadStoreIncrementsI = (index & 1) != 0;
+    q.shiftReadsVY = (index & 2) != 0;
+    q.logicResetsVF = (index & 4) != 0;
+    q.wrapSprites = (index & 8) != 0;
+    return q;
+}
+
+bool Chip8Quirks::parse(const char *text, Chip8Quirks &quirks)
+{
+    const std::string spec(text);
+    if (spec == "none")
+    {
+        quirks = Chip8Quirks();
+        return true;
+    }
+    if (spec == "vip")
+    {
+        quirks = fromIndex(1 | 2 | 4);
+        return true;
+    }
 
-    if (loggingEnabled)
+    int index = 0;
+    size_t start = 0;
+    while (start <= spec.size())
     {
-        Logger logger = Logger("log.jsonl");
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(start, end - start);
+        int bit = 0;
+        while (bit < 4 && item != QUIRK_NAMES[bit]) ++bit;
+        if (bit == 4) return false;
+        index |= 1 << bit;
+        start = end + 1;
     }
+    quirks = fromIndex(index);
+    return true;
+}
+
+std::string Chip8Quirks::name() const
+{
+    std::string name;
+    for (int bit = 0; bit < 4; ++bit)
+    {
+        if (!(index() & (1 << bit))) continue;
+        if (!name.empty()) name += ',';
+        name += QUIRK_NAMES[bit];
+    }
+    return name.empty() ? "none" : name;
+}
+
+Chip8::Chip8()
+{
+    seedRandom(rand());
 }
 
 void Chip8::initialize()
@@ -37,16 +168,33 @@ void Chip8::initialize()
     // clear memory
     memset(memory, 0, sizeof(memory));
 
+    // clear display and keypad
+    memset(gfx, 0, sizeof(gfx));
+    memset(key, 0, sizeof(key));
+
     // Load fontset
     for (int i = 0; i < 80; ++i)
     {
         memory[i] = chip8_fontset[i];
     }
 
-    // reset timers
-    delay_timer = 0;
-    sound_timer = 0;
+    // reset timers and emulated time
+    cycles = 0;
+    delayStart = soundStart = 0;
+    delaySetTick = soundSetTick = 0;
+
+    // XO-CHIP draws on plane 1 and beeps until told otherwise
+    planes = 1;
+    static const unsigned char SILENT[16] = {0};
+    setAudio(SILENT, 64, false);
+
+    nativeCheck = true;
+}
 
+void Chip8::setXOChip(bool on)
+{
+    xoChip = on;
+    addrMask = on ? 0xFFFF : 0x0FFF;
 }
 
 
@@ -65,9 +213,17 @@ bool Chip8::loadGame(const char *filename)
     // Get the file size
     fseek(file, 0, SEEK_END);
     long bufferSize = ftell(file);
-    Chip8::bufferSize = bufferSize;
     fseek(file, 0, SEEK_SET);
 
+    // anything past the end of memory has nowhere to go
+    if (bufferSize < 0 || bufferSize > addrMask + 1 - 512)
+    {
+        std::cerr << "ROM too large: " << bufferSize << " bytes" << std::endl;
+        fclose(file);
+        return false;
+    }
+    Chip8::bufferSize = bufferSize;
+
     // Allocate buffer to hold the file contents
     char *buffer = new char[bufferSize];
     if (buffer == nullptr)
@@ -96,25 +252,66 @@ bool Chip8::loadGame(const char *filename)
     delete[] buffer;
     fclose(file);
 
+    nativeCheck = true;
+    return true;
+}
+
+// Load a ROM image from a buffer into memory at 0x200
+bool Chip8::loadROM(const unsigned char *data, long size)
+{
+    if (size < 0 || size > addrMask + 1 - 512)
+    {
+        std::cerr << "ROM too large: " << size << " bytes" << std::endl;
+        return false;
+    }
+
+    memcpy(memory + 512, data, size);
+    bufferSize = size;
+    nativeCheck = true;
+    return true;
+}
+
+bool Chip8::reloadROM(const unsigned char *data, long size, const unsigned char *previous, bool keepState)
+{
+    if (size < 0 || size > addrMask + 1 - 512)
+    {
+        std::cerr << "ROM too large: " << size << " bytes" << std::endl;
+        return false;
+    }
+    if (!keepState)
+    {
+        initialize();
+        drawFlag = true;
+        return loadROM(data, size);
+    }
+
+    // past its end the new image is zeros, like after a load
+    for (long i = 0; i < addrMask + 1 - 512; ++i)
+    {
+        const unsigned char byte = i < size ? data[i] : 0;
+        if (byte != previous[i]) memory[512 + i] = byte;
+    }
+    bufferSize = size;
+    nativeCheck = true; // compiled code only runs again where memory still matches
+    drawFlag = true;    // refresh the debugger listing
     return true;
 }
 
 // Emulate one cycle of the system
 void Chip8::emulateCycle()
 {
-
     // Fetch Opcode
-    opcode = memory[pc] << 8 | memory[pc + 1]; // value of first memory address, shifted 8 to the left and concatenated with the seccond value
+    opcode = memory[pc & addrMask] << 8 | memory[(pc + 1) & addrMask]; // value of first memory address, shifted 8 to the left and concatenated with the seccond value
 
-    //printf("Executing opcode: 0x%X at PC: %X\n", opcode, pc);
+    cycles += timing.cost[opcode >> 12]; // charged up front, FX0A waiting costs too and the timers keep running
 
-/*     if (loggingEnabled)
+    if (heatOn)
     {
-        std::ostringstream logStream;
-        logStream << "\"Opcode\": \"0x" << std::hex << std::uppercase << opcode 
-                  << "\", \"PC\": \"0x" << std::hex << std::uppercase << pc << "\"";
-        logger.writeLog(logStream.str().c_str());
-    } */
+        heatRead(pc);
+        heatRead(pc + 1);
+    }
+
+    LOG_TRACE("Executing opcode: 0x%X at PC: %X", opcode, pc);
 
     // Decode & Execute Opcode
     switch (opcode & 0xF000) // only need 12 bits so mask the rest
@@ -124,18 +321,17 @@ void Chip8::emulateCycle()
         {
         case 0x00E0:
             // Clear the display
-            std::cout << "Clear the display" << std::endl;
-            gfxPtr->clearDisplay();
+            clearScreen();
             pc += 2;
             break;
         case 0x00EE:
-            // Return from subroutine
+            // Return from subroutine, the stack wraps instead of underflowing
             sp--;
-            pc = stack[sp];
+            pc = stack[sp & 0xF];
             pc += 2;
             break;
         default:
-            // std::cout << "Call machine code routine (not needed on most machines)" << std::endl;
+            LOG_DEBUG("Call machine code routine 0x%X (not needed on most machines)", opcode & 0x0FFF);
             break;
         }
         break;
@@ -144,7 +340,7 @@ void Chip8::emulateCycle()
         pc = opcode & 0x0FFF; // set pc to NNN by masking off the first un needed bits
         break;
     case 0x2000:        // call subroutine at NNN
-        stack[sp] = pc; // add current pc to stack
+        stack[sp & 0xF] = pc; // add current pc to stack, wraps after 16 levels
         sp++;
         pc = opcode & 0x0FFF; // set pc to NNN by masking off the first un needed bits
         break;
@@ -152,7 +348,7 @@ void Chip8::emulateCycle()
         // 0x3XNN
         if (V[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF))
         {
-            pc += 4;
+            pc += skipLength();
         }
         else
         {
@@ -162,7 +358,7 @@ void Chip8::emulateCycle()
     case 0x4000: // Skip next instruction if VX does not equal NN
         if (V[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF))
         {
-            pc += 4;
+            pc += skipLength();
         }
         else
         {
@@ -171,9 +367,26 @@ void Chip8::emulateCycle()
         break;
     case 0x5000: // Skip the next instruction if Vx equals Vy
         // 0x5XY0
-        if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
+        if (xoChip && (opcode & 0x000E) == 0x0002)
+        {
+            // XO-CHIP 5XY2 / 5XY3: save / load VX to VY at I, either direction, I stays
+            const int x = (opcode & 0x0F00) >> 8;
+            const int y = (opcode & 0x00F0) >> 4;
+            const int count = (x < y ? y - x : x - y) + 1;
+            const int dir = x < y ? 1 : -1;
+            const bool save = (opcode & 0x000F) == 0x0002;
+            for (int i = 0; i < count; ++i)
+            {
+                unsigned char &byte = memory[(I + i) & addrMask];
+                if (save) byte = V[x + i * dir];
+                else V[x + i * dir] = byte;
+            }
+            if (save) memoryWritten(I, count);
+            pc += 2;
+        }
+        else if (V[(opcode & 0x0F00) >> 8] == V[(opcode & 0x00F0) >> 4])
         {
-            pc += 4;
+            pc += skipLength();
         }
         else
         {
@@ -201,16 +414,19 @@ void Chip8::emulateCycle()
         case 0x0001: // Set Vx to (Vx or Vy)
             // 0x8XY1
             V[(opcode & 0x0F00) >> 8] = (V[(opcode & 0x0F00) >> 8] | V[(opcode & 0x00F0) >> 4]);
+            if (quirks.logicResetsVF) V[0xF] = 0;
             pc += 2;
             break;
         case 0x0002: // Set Vx to (Vx and Vy)
             // 8XY2
             V[(opcode & 0x0F00) >> 8] = (V[(opcode & 0x0F00) >> 8] & V[(opcode & 0x00F0) >> 4]);
+            if (quirks.logicResetsVF) V[0xF] = 0;
             pc += 2;
             break;
         case 0x0003: // Set Vx to (Vx xor Vy)
             // 8XY3
             V[(opcode & 0x0F00) >> 8] = (V[(opcode & 0x0F00) >> 8] ^ V[(opcode & 0x00F0) >> 4]);
+            if (quirks.logicResetsVF) V[0xF] = 0;
             pc += 2;
             break;
         case 0x0004: // 8XY4: Add VY to VX, set VF to 1 if there's a carry, otherwise 0
@@ -256,6 +472,7 @@ void Chip8::emulateCycle()
         case 0x0006: // 8XY6: Store the least significant bit of Vx in Vf and shift Vx to the right by 1
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
+            if (quirks.shiftReadsVY) V[x] = V[(opcode & 0x00F0) >> 4];
             V[0xF] = V[x] & 0x1; // Store the least significant bit in Vf
             V[x] >>= 1;          // Shift Vx to the right by 1
             pc += 2;
@@ -284,13 +501,14 @@ void Chip8::emulateCycle()
         case 0x000E: // 8XYE: Store the most significant bit of Vx in Vf and shift Vx to the left by 1
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
+            if (quirks.shiftReadsVY) V[x] = V[(opcode & 0x00F0) >> 4];
             V[0xF] = (V[x] & 0x80) >> 7; // Store the most significant bit in Vf
             V[x] <<= 1;                  // Shift Vx to the left by 1
             pc += 2;
             break;
         }
         default:
-            printf("Unknown opcode: 0x%X at PC: %d\n", opcode, pc);
+            LOG_WARN("Unknown opcode: 0x%X at PC: %X", opcode, pc);
             break;
         }
         break;
@@ -300,7 +518,7 @@ void Chip8::emulateCycle()
         uint8_t y = (opcode & 0x00F0) >> 4;
         if (V[x] != V[y])
         {
-            pc += 4;
+            pc += skipLength();
         }
         else
         {
@@ -323,7 +541,7 @@ void Chip8::emulateCycle()
     {
         uint8_t x = (opcode & 0x0F00) >> 8;
         uint8_t nn = opcode & 0x00FF;
-        V[x] = (rand() % 256) & nn;
+        V[x] = nextRandom() & nn;
         pc += 2;
         break;
     }
@@ -332,26 +550,16 @@ void Chip8::emulateCycle()
         unsigned short x = V[(opcode & 0x0F00) >> 8];
         unsigned short y = V[(opcode & 0x00F0) >> 4];
         unsigned short n = opcode & 0x000F;
-        unsigned short pixel;
-
-        V[0xF] = 0; // reset Vf register
 
-        for (int ycount = 0; ycount < n; ycount++)
+        if (timing.displayWait)
         {
-            pixel = memory[I + ycount];
-            for (int xcount = 0; xcount < 8; xcount++)
-            {
-                if ((pixel & (0x80 >> xcount)) != 0)
-                {
-                    if (gfx[(x + xcount + ((y + ycount) * 64))] == 1)
-                    {
-                        V[0xF] = 1; // set flag to true
-                    }
-                    gfx[x + xcount + ((y + ycount) * 64)] ^= 1;
-                }
-            }
+            // the VIP only draws in the vertical blank, sleep until the next frame starts
+            const unsigned long long tick = ticksAt(cycles);
+            if (cycles != tickStart(tick)) cycles = tickStart(tick + 1);
         }
-        drawFlag = true;
+
+        if (tracing) spriteDrawn(I, n);
+        V[0xF] = drawSprite(I, x, y, n); // Vf set on collision
         pc += 2;
         break;
     }
@@ -361,9 +569,10 @@ void Chip8::emulateCycle()
         case 0x009E: // EX9E: Skip the next instruction if the key stored in VX is pressed
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            if (key[V[x]] != 0)
+            keyTested(V[x] & 0xF);
+            if (key[V[x] & 0xF] != 0)
             {
-                pc += 4; // Skip the next instruction
+                pc += skipLength(); // Skip the next instruction
             }
             else
             {
@@ -374,9 +583,10 @@ void Chip8::emulateCycle()
         case 0x00A1: // EXA1: Skip the next instruction if the key stored in VX is not pressed
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            if (key[V[x]] == 0)
+            keyTested(V[x] & 0xF);
+            if (key[V[x] & 0xF] == 0)
             {
-                pc += 4; // Skip the next instruction
+                pc += skipLength(); // Skip the next instruction
             }
             else
             {
@@ -389,10 +599,40 @@ void Chip8::emulateCycle()
     case 0xF000:
         switch (opcode & 0x00FF)
         {
+        case 0x0000: // XO-CHIP F000 NNNN: Set I to the 16-bit address in the next word
+            if (xoChip && opcode == 0xF000)
+            {
+                I = memory[(pc + 2) & addrMask] << 8 | memory[(pc + 3) & addrMask];
+                pc += 4;
+            }
+            break;
+        case 0x0001: // XO-CHIP FN01: Select the bitplanes 00E0 and DXYN work on
+            if (xoChip)
+            {
+                planes = (opcode & 0x0F00) >> 8 & 3;
+                pc += 2;
+            }
+            break;
+        case 0x0002: // XO-CHIP F002: Load the 16 byte audio pattern from I
+            if (xoChip && opcode == 0xF002)
+            {
+                unsigned char loaded[16];
+                for (int i = 0; i < 16; ++i) loaded[i] = memory[(I + i) & addrMask];
+                setAudio(loaded, pitch, true);
+                pc += 2;
+            }
+            break;
+        case 0x003A: // XO-CHIP FX3A: Set the audio pattern pitch to VX
+            if (xoChip)
+            {
+                setAudio(pattern, V[(opcode & 0x0F00) >> 8], patternLoaded);
+                pc += 2;
+            }
+            break;
         case 0x0007: // FX07: Set VX to the value of the delay timer
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            V[x] = delay_timer;
+            V[x] = getDelayTimer();
             pc += 2;
             break;
         }
@@ -406,6 +646,7 @@ void Chip8::emulateCycle()
             {
                 if (key[i] != 0)
                 {
+                    keyTested(i);
                     V[x] = i;
                     keyPressDetected = true;
                     break;
@@ -423,14 +664,16 @@ void Chip8::emulateCycle()
         case 0x0015: // FX15: Set the delay timer to VX
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            delay_timer = V[x];
+            delayStart = V[x];
+            delaySetTick = ticksAt(cycles);
             pc += 2;
             break;
         }
         case 0x0018: // FX18: Set the sound timer to VX
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            sound_timer = V[x];
+            soundStart = V[x];
+            soundSetTick = ticksAt(cycles);
             pc += 2;
             break;
         }
@@ -451,9 +694,10 @@ void Chip8::emulateCycle()
         case 0x0033: // FX33: Store the binary-coded decimal representation of VX
         {
             uint8_t x = (opcode & 0x0F00) >> 8;
-            memory[I] = V[x] / 100;
-            memory[I + 1] = (V[x] / 10) % 10;
-            memory[I + 2] = (V[x] % 100) % 10;
+            memory[I & addrMask] = V[x] / 100;
+            memory[(I + 1) & addrMask] = (V[x] / 10) % 10;
+            memory[(I + 2) & addrMask] = (V[x] % 100) % 10;
+            memoryWritten(I, 3);
             pc += 2;
             break;
         }
@@ -462,9 +706,10 @@ void Chip8::emulateCycle()
             uint8_t x = (opcode & 0x0F00) >> 8;
             for (uint8_t i = 0; i <= x; ++i)
             {
-                memory[I + i] = V[i];
+                memory[(I + i) & addrMask] = V[i];
             }
-            // I += x + 1; // On the original interpreter, I is incremented by x + 1 after this operation.
+            memoryWritten(I, x + 1);
+            if (quirks.loadStoreIncrementsI) I += x + 1; // the original interpreter left I past the last register
             pc += 2;
             break;
         }
@@ -473,9 +718,10 @@ void Chip8::emulateCycle()
             uint8_t x = (opcode & 0x0F00) >> 8;
             for (uint8_t i = 0; i <= x; ++i)
             {
-                V[i] = memory[I + i];
+                V[i] = memory[(I + i) & addrMask];
+                if (heatOn) heatRead(I + i);
             }
-            // I += x + 1; // On the original interpreter, I is incremented by x + 1 after this operation.
+            if (quirks.loadStoreIncrementsI) I += x + 1;
             pc += 2;
             break;
         }
@@ -483,106 +729,620 @@ void Chip8::emulateCycle()
         break;
 
     default:
-        printf("Unknown opcode: 0x%X at PC: %d\n", opcode, pc);
+        LOG_WARN("Unknown opcode: 0x%X at PC: %X", opcode, pc);
+    }
+}
+
+// Set the state of the keypad
+void Chip8::setKey(int key, int value)
+{
+    Chip8::key[key & 0xF] = value;
+    LOG_DEBUG("Key %X %s", key & 0xF, value ? "down" : "up");
+}
+
+void Chip8::clearKeys()
+{
+    memset(key, 0, sizeof(key)); 
+}
+
+void Chip8::traceKey(int key, long long eventTime)
+{
+    // replaces a press still in flight, the newest one is what the player waits on
+    const unsigned long id = keyTrace.id + 1;
+    keyTrace = Chip8KeyTrace();
+    keyTrace.id = id;
+    keyTrace.key = key & 0xF;
+    keyTrace.event = eventTime;
+    keyTrace.applied = chip8Now();
+    tracing = true;
+    traceUntil = tickStart(ticksAt(cycles) + TRACE_FRAMES);
+}
+
+// The first sprite after the key was tested that sets any pixel ends the trace
+void Chip8::spriteDrawn(unsigned short addr, unsigned int n)
+{
+    if (keyTrace.observed == 0) return;
+    for (unsigned int row = 0; row < n; ++row)
+    {
+        if (memory[(addr + row) & addrMask])
+        {
+            keyTrace.drawn = chip8Now();
+            tracing = false;
+            return;
+        }
+    }
+}
+
+
+
+void Chip8::tickTimers(unsigned int ticks)
+{
+    // restart both from where they are now, ticks further down
+    const unsigned long long now = ticksAt(cycles);
+    const unsigned char delay = getDelayTimer();
+    const unsigned char sound = getSoundTimer();
+    delayStart = delay > ticks ? delay - ticks : 0;
+    soundStart = sound > ticks ? sound - ticks : 0;
+    delaySetTick = soundSetTick = now;
+}
+
+void Chip8::setTiming(const Chip8Timing &timing)
+{
+    // keep the current timer values across the change
+    const unsigned char delay = getDelayTimer();
+    const unsigned char sound = getSoundTimer();
+
+    this->timing = timing;
+    if (this->timing.clockRate == 0) this->timing.clockRate = 1;
+    maxCost = 1;
+    nativeTiming = !timing.displayWait;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (this->timing.cost[i] == 0) this->timing.cost[i] = 1;
+        maxCost = std::max<unsigned int>(maxCost, this->timing.cost[i]);
+        nativeTiming = nativeTiming && this->timing.cost[i] == 1;
+    }
+
+    delayStart = delay;
+    soundStart = sound;
+    delaySetTick = soundSetTick = ticksAt(cycles);
+}
+
+int Chip8::cyclesToNextTick() const
+{
+    return static_cast<int>(tickStart(ticksAt(cycles) + 1) - cycles);
+}
+
+
+void Chip8::setDisassembler(Chip8Disassembler* disasmPtr) {
+    this->disasmPtr = disasmPtr;
+}
+
+void Chip8::saveState(Chip8State &state) const
+{
+    state.memorySize = addrMask + 1u;
+    memcpy(state.memory, memory, state.memorySize);
+    memcpy(state.gfx, gfx, sizeof(gfx));
+    memcpy(state.V, V, sizeof(V));
+    memcpy(state.stack, stack, sizeof(stack));
+    memcpy(state.key, key, sizeof(key));
+    state.I = I;
+    state.pc = pc;
+    state.sp = sp;
+    state.delay_timer = getDelayTimer();
+    state.sound_timer = getSoundTimer();
+    state.rngState = rngState;
+    state.cycles = cycles;
+    state.planes = planes;
+    state.pitch = pitch;
+    memcpy(state.pattern, pattern, sizeof(pattern));
+    state.patternLoaded = patternLoaded;
+}
+
+void Chip8::loadState(const Chip8State &state)
+{
+    // a 4K state into an XO-CHIP machine leaves the rest of its 64K clear
+    const size_t size = std::min<size_t>(addrMask + 1u, state.memorySize);
+    memcpy(memory, state.memory, size);
+    memset(memory + size, 0, addrMask + 1u - size);
+    memcpy(gfx, state.gfx, sizeof(gfx));
+    memcpy(V, state.V, sizeof(V));
+    memcpy(stack, state.stack, sizeof(stack));
+    memcpy(key, state.key, sizeof(key));
+    I = state.I;
+    pc = state.pc;
+    sp = state.sp;
+    cycles = state.cycles;
+    delayStart = state.delay_timer;
+    soundStart = state.sound_timer;
+    delaySetTick = soundSetTick = ticksAt(cycles);
+    rngState = state.rngState;
+    planes = state.planes;
+    setAudio(state.pattern, state.pitch, state.patternLoaded);
+    nativeCheck = true;
+}
+
+// Moves the audio version only on a real change, the host recomputes the waveform on each
+void Chip8::setAudio(const unsigned char *newPattern, unsigned char newPitch, bool loaded)
+{
+    if (newPitch == pitch && loaded == patternLoaded && memcmp(newPattern, pattern, sizeof(pattern)) == 0) return;
+    memmove(pattern, newPattern, sizeof(pattern));
+    pitch = newPitch;
+    patternLoaded = loaded;
+    ++audioVersion;
+}
+
+void Chip8::saveFrame(Chip8Frame &frame) const
+{
+    saveState(frame.state);
+    frame.clockRate = timing.clockRate;
+    frame.xoChip = xoChip;
+    frame.paused = paused;
+    memcpy(frame.breakReason, breakReason, sizeof(breakReason));
+    if (frame.breakpointsVersion != breakpointVersion)
+    {
+        memcpy(frame.breakpoints, breakpointMap, sizeof(breakpointMap));
+        frame.breakpointsVersion = breakpointVersion;
+    }
+    frame.keyTrace = keyTrace;
+    frame.heatOn = heatOn;
+    if (heatOn)
+    {
+        memcpy(frame.heatReads, heatReads, sizeof(heatReads));
+        memcpy(frame.heatWrites, heatWrites, sizeof(heatWrites));
     }
 
-    // Update timers
-    if (delay_timer > 0)
+    // three slots take turns, each catches up once per analysis change
+    if (disasmPtr && frame.listingVersion != disasmPtr->getVersion())
     {
-        --delay_timer;
+        disasmPtr->buildListing(frame.listing);
+        frame.listingVersion = disasmPtr->getVersion();
     }
+}
+
+void Chip8::clearScreen()
+{
+    LOG_TRACE("Clear the display");
+    const unsigned char keep = static_cast<unsigned char>(~planes); // XO-CHIP only clears the selected planes
+    for (size_t i = 0; i < sizeof(gfx); ++i) gfx[i] &= keep;
+    drawFlag = true; // the renderer only sees published frames
+}
 
-    if (sound_timer > 0)
+// DXYN with the sprite at addr, returns the collision flag. Each selected
+// plane takes its own n rows from addr on, plane 1 first
+unsigned char Chip8::drawSprite(unsigned short addr, unsigned int x, unsigned int y, unsigned int n)
+{
+    // the position wraps onto the screen, what sticks out past the right or
+    // bottom edge is clipped, or comes in on the other side with wrapSprites
+    x &= 63;
+    y &= 31;
+    const size_t len = std::min(8u, 64 - x); // pixels left of the right edge
+    const bool wrap = quirks.wrapSprites;
+
+    unsigned char collision = 0;
+    for (unsigned char plane = 1; plane <= 2; plane <<= 1)
     {
-        if (sound_timer == 1)
+        if (!(planes & plane)) continue;
+        for (unsigned int ycount = 0; ycount < n; ycount++, addr++)
         {
-            printf("Beep!\n");
-            beep_set_on(true);
-            
+            const unsigned char bits = memory[addr & addrMask];
+            if (heatOn) heatRead(addr);
+
+            const unsigned int row = y + ycount;
+            if (row >= 32 && !wrap) continue;
+            unsigned char *line = gfx + (row & 31) * 64;
+
+            unsigned char pixels[8] = {0};
+            memcpy(pixels, line + x, len);
+            if (wrap) memcpy(pixels + len, line, 8 - len);
+
+            uint64_t row64;
+            memcpy(&row64, pixels, 8);
+            const uint64_t sprite = SPRITE_ROWS.row[bits] * plane;
+            if (row64 & sprite) collision = 1;
+            row64 ^= sprite;
+            memcpy(pixels, &row64, 8);
+
+            memcpy(line + x, pixels, len);
+            if (wrap) memcpy(line, pixels + len, 8 - len);
         }
-        --sound_timer;
     }
+    drawFlag = true;
+    return collision;
 }
 
-// Set the state of the keypad
-void Chip8::setKey(int key, int value)
+void Chip8::setNative(Chip8Native* nativePtr)
+{
+    this->nativePtr = (nativePtr && nativePtr->isLoaded()) ? nativePtr : nullptr;
+
+    Chip8NativeContext &c = nativeContext;
+    c.memory = memory;
+    c.V = V;
+    c.I = &I;
+    c.pc = &pc;
+    c.stack = stack;
+    c.sp = &sp;
+    c.key = key;
+    c.host = this;
+    c.clear = nativeClear;
+    c.draw = nativeDraw;
+    c.random = nativeRandom;
+    c.readTimer = nativeReadTimer;
+    c.writeTimer = nativeWriteTimer;
+    c.written = nativeWritten;
+    c.codeWritten = 0;
+    nativeCheck = true;
+}
+
+// Native code for as long as it lasts, one interpreted instruction whenever it stops
+int Chip8::runNative(int n)
 {
-    Chip8::key[key] = value;
-    if (loggingEnabled)
+    int left = n;
+    while (left > 0)
     {
-        std::ostringstream logStream;
-        logStream << "\"Key\": \"" << key << "\", \"Value\": \"" << value << "\"";
-        logger.writeLog(logStream.str().c_str());
+        if (nativeCheck)
+        {
+            // the ROM changed or wrote into its code, only run native while it matches again
+            nativeMatch = nativePtr->matches(memory);
+            nativeCheck = false;
+        }
+
+        if (nativeMatch)
+        {
+            nativeContext.cycle = cycles;
+            const int ran = nativePtr->run(&nativeContext, left);
+            cycles += ran;
+            left -= ran;
+            if (nativeContext.codeWritten)
+            {
+                nativeContext.codeWritten = 0;
+                nativeCheck = true;
+            }
+            if (left == 0) break;
+        }
+
+        emulateCycle();
+        --left;
     }
+    return n;
 }
 
-void Chip8::clearKeys()
+void Chip8::nativeClear(void *host)
 {
-    memset(key, 0, sizeof(key)); 
+    static_cast<Chip8 *>(host)->clearScreen();
 }
 
+unsigned char Chip8::nativeDraw(void *host, unsigned short addr, unsigned int x, unsigned int y, unsigned int n)
+{
+    return static_cast<Chip8 *>(host)->drawSprite(addr, x, y, n);
+}
 
+unsigned char Chip8::nativeRandom(void *host)
+{
+    return static_cast<Chip8 *>(host)->nextRandom();
+}
 
-void Chip8::tickTimers(){
-    if (delay_timer > 0) --delay_timer;
-    if (sound_timer > 0) --sound_timer;
+unsigned char Chip8::nativeReadTimer(void *host, int sound, unsigned long long cycle)
+{
+    const Chip8 *chip8 = static_cast<const Chip8 *>(host);
+    const unsigned long long tick = chip8->ticksAt(cycle);
+    return sound ? timerValue(chip8->soundStart, chip8->soundSetTick, tick)
+                 : timerValue(chip8->delayStart, chip8->delaySetTick, tick);
 }
 
+void Chip8::nativeWriteTimer(void *host, int sound, unsigned long long cycle, unsigned char value)
+{
+    Chip8 *chip8 = static_cast<Chip8 *>(host);
+    if (sound)
+    {
+        chip8->soundStart = value;
+        chip8->soundSetTick = chip8->ticksAt(cycle);
+    }
+    else
+    {
+        chip8->delayStart = value;
+        chip8->delaySetTick = chip8->ticksAt(cycle);
+    }
+}
 
-void Chip8::handleEvents(bool &running, bool &restart)
+void Chip8::nativeWritten(void *host, unsigned short addr, unsigned short len)
 {
-    static const std::unordered_map<SDL_Keycode, uint8_t> keymap = {
-        { SDLK_1, 0x1 }, { SDLK_2, 0x2 }, { SDLK_3, 0x3 }, { SDLK_4, 0xC },
-        { SDLK_q, 0x4 }, { SDLK_w, 0x5 }, { SDLK_e, 0x6 }, { SDLK_r, 0xD },
-        { SDLK_a, 0x7 }, { SDLK_s, 0x8 }, { SDLK_d, 0x9 }, { SDLK_f, 0xE },
-        { SDLK_z, 0xA }, { SDLK_x, 0x0 }, { SDLK_c, 0xB }, { SDLK_v, 0xF },
-    };
+    Chip8 *chip8 = static_cast<Chip8 *>(host);
+    if (chip8->disasmPtr) chip8->disasmPtr->memoryWritten(addr, len);
+}
+
+void Chip8::seedRandom(unsigned int seed)
+{
+    rngState = seed ? seed : 0x9E3779B9u; // xorshift gets stuck on zero
+}
+
+// xorshift32, the low byte is used as the random number
+unsigned char Chip8::nextRandom()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState & 0xFF;
+}
+
+// --- Debugger ---
+
+int Chip8::runCycles(int n)
+{
+    if (paused) return 0;
+
+    // a press the program never tests or never draws for is given up on
+    if (tracing && cycles >= traceUntil) tracing = false;
 
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
+    if (!debugArmed)
     {
-        switch (event.type)
+        // native code can't count for the heat map, nor stamp a traced key
+        // press, which then runs out its frames unanswered
+        if (nativePtr && nativeTiming && !xoChip && quirks.isDefault() && !heatOn) return runNative(n);
+
+        // nothing armed, plain interpreter loop
+        for (int i = 0; i < n; ++i)
         {
-            case SDL_QUIT:
-                running = false;
-                break;
+            emulateCycle();
+        }
+        return n;
+    }
 
-            case SDL_KEYDOWN:
-            case SDL_KEYUP:
-            {
-                const bool pressed = (event.type == SDL_KEYDOWN);
+    for (int i = 0; i < n; ++i)
+    {
+        if ((pc < 4096 ? breakpointMap[pc] : highBreakpoints) && !skipBreakpoint && checkBreakpoint())
+        {
+            return i;
+        }
+        skipBreakpoint = false;
 
-                // global keys
-                if (event.key.keysym.sym == SDLK_ESCAPE)
-                {
-                    if (pressed)  // only on press
-                    {
-                        restart = true;
-                        running = false;
-                    }
-                    break;
-                }
+        emulateCycle();
+        if (paused) return i + 1; // watchpoint hit
+    }
+    return n;
+}
+
+int Chip8::runFrame()
+{
+    const unsigned long long end = tickStart(ticksAt(cycles) + 1);
+    int executed = 0;
+    while (cycles < end && !paused)
+    {
+        // no instruction costs more than maxCost, so a batch can't run past the
+        // frame; a display wait can jump to its end though, take those one by one
+        const unsigned long long n = timing.displayWait ? 1 : (end - cycles + maxCost - 1) / maxCost;
+        const int ran = runCycles(static_cast<int>(n));
+        executed += ran;
+        if (ran == 0) break; // breakpoint
+    }
+    return executed;
+}
+
+int Chip8::runAhead(int frames, Chip8Frame &frame, Chip8State &present)
+{
+    saveState(present);
+    const bool draw = drawFlag;
+    const unsigned long audio = audioVersion; // the host hears the present
+
+    // nothing outside the machine state may remember the future
+    Chip8Disassembler *const disasm = disasmPtr;
+    const bool heat = heatOn, armed = debugArmed, watch = watchArmed;
+    disasmPtr = nullptr;
+    heatOn = debugArmed = watchArmed = false;
+
+    int executed = 0;
+    {
+        Logger::Mute mute; // only this thread, the log stays on for the rest
+        for (int f = 0; f < frames; ++f)
+        {
+            executed += runFrame();
+        }
+    }
+
+    disasmPtr = disasm;
+    heatOn = heat;
+    debugArmed = armed;
+    watchArmed = watch;
+    saveFrame(frame);
+
+    loadState(present);
+    drawFlag = draw;
+    audioVersion = audio;
+    return executed;
+}
+
+void Chip8::pause()
+{
+    paused = true;
+    snprintf(breakReason, sizeof(breakReason), "paused at %03X", pc);
+    drawFlag = true; // refresh the debugger
+}
+
+void Chip8::resume()
+{
+    paused = false;
+    skipBreakpoint = true; // execute the instruction we are stopped on
+}
+
+void Chip8::step()
+{
+    if (!paused) pause();
+
+    emulateCycle();
+    snprintf(breakReason, sizeof(breakReason), "step to %03X", pc);
+    drawFlag = true;
+}
+
+void Chip8::stepOver()
+{
+    if (!paused) pause();
+
+    // only calls need more than one instruction, break once they return
+    if ((memory[pc & addrMask] & 0xF0) != 0x20)
+    {
+        step();
+        return;
+    }
+
+    if (stepOverSP >= 0) markBreakpoint(stepOverAddr, -1);
+    stepOverAddr = pc + 2;
+    stepOverSP = sp;
+    markBreakpoint(stepOverAddr, +1);
+    updateArmed();
+    resume();
+}
+
+void Chip8::addBreakpoint(unsigned short addr)
+{
+    addConditionalBreakpoint(addr, -1, '=', 0);
+}
+
+void Chip8::addConditionalBreakpoint(unsigned short addr, int reg, char op, unsigned short value)
+{
+    Chip8Breakpoint bp = {addr, reg, op, value};
+    breakpoints.push_back(bp);
+    markBreakpoint(addr, +1);
+    updateArmed();
+}
 
-                // chip8 keys
-                auto it = keymap.find(event.key.keysym.sym);
-                if (it != keymap.end())
-                    setKey(it->second, pressed);
+void Chip8::removeBreakpoints(unsigned short addr)
+{
+    for (size_t i = 0; i < breakpoints.size();)
+    {
+        if (breakpoints[i].addr == addr)
+        {
+            markBreakpoint(addr, -1);
+            breakpoints.erase(breakpoints.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    updateArmed();
+}
 
-                break;
+bool Chip8::hasBreakpoint(unsigned short addr) const
+{
+    for (size_t i = 0; i < breakpoints.size(); ++i)
+    {
+        if (breakpoints[i].addr == addr) return true;
+    }
+    return false;
+}
+
+// The map only covers the first 4K, XO-CHIP breakpoints above it share one count
+void Chip8::markBreakpoint(unsigned short addr, int delta)
+{
+    if (addr < 4096) breakpointMap[addr] += delta;
+    else highBreakpoints += delta;
+}
+
+void Chip8::addWatchpoint(unsigned short addr, unsigned short len)
+{
+    // kept as ints, a range running to the end of 64K must not wrap to a small end
+    watchpoints.push_back(std::make_pair(static_cast<int>(addr), std::min(addr + len, 0x10000)));
+    updateArmed();
+}
+
+void Chip8::clearWatchpoints()
+{
+    watchpoints.clear();
+    updateArmed();
+}
+
+// Only called when the PC has something armed on it
+bool Chip8::checkBreakpoint()
+{
+    if (stepOverSP >= 0 && pc == stepOverAddr && sp <= stepOverSP)
+    {
+        markBreakpoint(stepOverAddr, -1);
+        stepOverSP = -1;
+        updateArmed();
+        pause();
+        snprintf(breakReason, sizeof(breakReason), "step over to %03X", pc);
+        return true;
+    }
+
+    for (size_t i = 0; i < breakpoints.size(); ++i)
+    {
+        const Chip8Breakpoint &bp = breakpoints[i];
+        if (bp.addr != pc) continue;
+
+        bool hit = true;
+        if (bp.reg >= 0)
+        {
+            const unsigned short value = (bp.reg < 16) ? V[bp.reg] : I;
+            switch (bp.op)
+            {
+            case '=': hit = value == bp.value; break;
+            case '!': hit = value != bp.value; break;
+            case '<': hit = value < bp.value; break;
+            case '>': hit = value > bp.value; break;
             }
+        }
 
-            default:
-                break;
+        if (hit)
+        {
+            pause();
+            snprintf(breakReason, sizeof(breakReason), "breakpoint at %03X", pc);
+            return true;
         }
     }
+    return false;
 }
 
+// FX33/FX55/5XY2 stored [addr, addr + len), split where the store wrapped around memory
+void Chip8::memoryWritten(unsigned short addr, unsigned short len)
+{
+    addr &= addrMask;
+    while (len > 0)
+    {
+        const unsigned short part = (addr + len > addrMask + 1) ? addrMask + 1 - addr : len;
+        if (watchArmed) checkWatchpoint(addr, part);
+        if (addr < 4096)
+        {
+            // code, the analysis and the debugger views are all in the first 4K
+            const unsigned short low = (addr + part > 4096) ? 4096 - addr : part;
+            if (disasmPtr) disasmPtr->memoryWritten(addr, low);
+            if (nativePtr && nativePtr->touchesCode(addr, low)) nativeCheck = true;
+            if (heatOn)
+            {
+                for (unsigned short a = addr; a < addr + low; ++a) ++heatWrites[a];
+            }
+        }
+        addr = 0;
+        len -= part;
+    }
+}
 
-void Chip8::enableLogging()
+void Chip8::setHeatMap(bool on)
 {
-    loggingEnabled = true;
+    if (on && !heatOn)
+    {
+        memset(heatReads, 0, sizeof(heatReads));
+        memset(heatWrites, 0, sizeof(heatWrites));
+    }
+    heatOn = on;
+    drawFlag = true; // show or hide it in the debugger
 }
 
-void Chip8::setGFX(Chip8GFX* gfxPtr) {
-    this->gfxPtr = gfxPtr;
-}
\ No newline at end of file
+void Chip8::checkWatchpoint(int addr, int len)
+{
+    for (size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        if (addr < watchpoints[i].second && addr + len > watchpoints[i].first)
+        {
+            pause();
+            snprintf(breakReason, sizeof(breakReason), "write to %03X at %03X", addr, pc);
+            return;
+        }
+    }
+}
+
+void Chip8::updateArmed()
+{
+    ++breakpointVersion; // every change to breakpointMap ends up here
+    watchArmed = !watchpoints.empty();
+    debugArmed = !breakpoints.empty() || watchArmed || stepOverSP >= 0;
+}
@@ -3,14 +3,91 @@
 
 #include <SDL2/SDL.h>
 #include <SDL_ttf.h>
+#include <cstddef>
 #include <fstream>
-#include "logger.h"
 #include <string>
 #include <vector>
 #include <utility>
-#include "chip8gfx.h"
+#include "chip8native.h"
+#include "chip8latency.h"
 
-class Chip8GFX; // Forward declaration of Chip8GFX class
+class Chip8Disassembler;
+struct Chip8Frame;
+
+// Plain copy of the complete machine state, used to move an instance between engines.
+// Only the first memorySize bytes of memory are copied, so CHIP-8 states move
+// 4K and not XO-CHIP's 64K; used() is what is valid from the start
+struct Chip8State
+{
+    unsigned char gfx[64 * 32]; // bit 0 plane 1, bit 1 plane 2
+    unsigned char V[16];
+    unsigned short I;
+    unsigned short pc;
+    unsigned short stack[16];
+    unsigned short sp;
+    unsigned char delay_timer;  // as of cycles
+    unsigned char sound_timer;
+    unsigned char key[16];
+    unsigned int rngState;
+    unsigned long long cycles;  // instructions executed, the timers follow this
+    unsigned char planes;       // XO-CHIP bitplanes 00E0 and DXYN work on, 1 for CHIP-8
+    unsigned char pitch;        // XO-CHIP audio pattern playback, 64 = 4000 bits/s
+    unsigned char pattern[16];  // XO-CHIP audio pattern, 128 one bit samples
+    bool patternLoaded;         // F002 ran, otherwise the sound timer plays the plain beep
+    unsigned int memorySize;    // 0x1000, 0x10000 for XO-CHIP
+    unsigned char memory[0x10000]; // last, the tail past memorySize is never touched
+
+    size_t used() const { return offsetof(Chip8State, memory) + memorySize; }
+};
+
+// Debugger breakpoint on a PC, optionally only taken when V[reg] or I matches
+struct Chip8Breakpoint
+{
+    unsigned short addr;
+    int reg;              // -1 always, 0x0-0xF for V[reg], 16 for I
+    char op;              // '=', '!', '<' or '>'
+    unsigned short value;
+};
+
+// How emulated time is charged. Every instruction costs cycles by its top
+// nibble, the 60Hz timers and frames follow the total at clockRate cycles
+// per emulated second.
+struct Chip8Timing
+{
+    unsigned int clockRate;  // cycles per emulated second
+    unsigned short cost[16]; // cycles per instruction, indexed by opcode >> 12, at least 1
+    bool displayWait;        // DXYN waits for the next frame like the VIP's interpreter
+
+    // Every instruction costs 1, clockRate instructions per second
+    static Chip8Timing flat(unsigned int instructionsPerSecond);
+
+    // Rough COSMAC VIP machine cycle counts, 3668 per frame, with the display wait
+    static Chip8Timing vip();
+
+    // Same costs, clockRate set to a whole number of cycles per 60Hz frame
+    Chip8Timing withCyclesPerFrame(unsigned int cycles) const;
+};
+
+// Behaviors CHIP-8 interpreters disagree on. All off is this emulator's own
+// and what the lockstep engine and native code implement; the COSMAC VIP
+// has the first three on.
+struct Chip8Quirks
+{
+    bool loadStoreIncrementsI = false; // FX55/FX65 leave I past the last register
+    bool shiftReadsVY = false;         // 8XY6/8XYE shift VY into VX, not VX in place
+    bool logicResetsVF = false;        // 8XY1/8XY2/8XY3 clear VF
+    bool wrapSprites = false;          // DXYN pixels past an edge come in on the other side, not clipped
+
+    // Every combination, numbered by index()
+    static const int COUNT = 16;
+    int index() const;
+    static Chip8Quirks fromIndex(int index);
+    bool isDefault() const { return index() == 0; }
+
+    // "none", "vip" or a comma list of inc-i, shift-vy, vf-reset and wrap
+    static bool parse(const char *text, Chip8Quirks &quirks);
+    std::string name() const;
+};
 
 class Chip8
 {
@@ -24,6 +101,20 @@ public:
     // Load the game into the memory
     bool loadGame(const char *filename);
 
+    // Load a ROM image that is already in host memory, fails if it doesn't fit
+    bool loadROM(const unsigned char *data, long size);
+
+    // Swap in a rebuilt ROM. With keepState the registers, timers and display
+    // stay and only bytes that differ from previous (the old image from 0x200
+    // to 0xFFF) are written, so data the program keeps in its own image
+    // survives; otherwise it's a full reset
+    bool reloadROM(const unsigned char *data, long size, const unsigned char *previous, bool keepState);
+
+    // XO-CHIP: 64K of memory, F000 NNNN, two bitplanes (FN01), 5XY2/5XY3
+    // and audio patterns (F002, FX3A). Set before loading, off is plain CHIP-8
+    void setXOChip(bool on);
+    bool isXOChip() const { return xoChip; }
+
     // Emulate one cycle of the system
     void emulateCycle();
 
@@ -34,19 +125,88 @@ public:
     //clear all keys
     void clearKeys();
 
-    // Update internal timers (sound/etc)
-    void tickTimers();
+    // Follow a key press that was just set through the program for the
+    // latency stats, see chip8latency.h. eventTime is from chip8Now()
+    void traceKey(int key, long long eventTime);
+    const Chip8KeyTrace& getKeyTrace() const { return keyTrace; }
 
-    bool drawFlag = false;
+    // The 60Hz timers are derived from the cycle count at clockRate cycles
+    // per second, nothing has to tick them. tickTimers moves them on by
+    // ticks without running anything, for scripts.
+    void tickTimers(unsigned int ticks = 1);
+    static const unsigned int DEFAULT_CLOCK_RATE = 500; // cycles per emulated second
+    void setTiming(const Chip8Timing &timing);
+    const Chip8Timing& getTiming() const { return timing; }
 
-    void handleEvents(bool &running, bool &restart);
+    // Which interpretation of the ambiguous instructions to run with
+    void setQuirks(const Chip8Quirks &quirks) { this->quirks = quirks; }
+    const Chip8Quirks& getQuirks() const { return quirks; }
+    unsigned long long getCycles() const { return cycles; }
 
-    void enableLogging();
+    // Cycles until the timers next move, the end of the current frame
+    int cyclesToNextTick() const;
 
-    void setGFX(Chip8GFX* gfxPtr); // Add this setter
+    bool drawFlag = false;
+
+    // Analysis to patch when the program writes into memory (FX33/FX55)
+    void setDisassembler(Chip8Disassembler* disasmPtr);
+    Chip8Disassembler* getDisassembler() { return disasmPtr; }
 
     unsigned char* getDisplayBuffer() { return gfx; }
 
+    // Run through an ahead of time compiled ROM (chip8c) while memory matches
+    // what it was compiled from, nullptr to interpret everything again
+    void setNative(Chip8Native* nativePtr);
+
+    // Copy the machine state out of / into this instance
+    void saveState(Chip8State &state) const;
+    void loadState(const Chip8State &state);
+
+    // Copy what the renderer and debugger show, see chip8frame.h
+    void saveFrame(Chip8Frame &frame) const;
+
+    // Seed the CXNN random number generator (xorshift32)
+    void seedRandom(unsigned int seed);
+
+    // --- Debugger ---
+
+    // Run up to n cycles, stopping early at armed breakpoints/watchpoints
+    // Returns the number of cycles executed
+    int runCycles(int n);
+
+    // Run the rest of the current 60Hz frame of emulated time, stopping early
+    // like runCycles. Returns the number of instructions executed
+    int runFrame();
+
+    // Run-ahead: emulate frames more frames with the keys as they are, copy
+    // that future into frame and put the machine back from present, the
+    // caller's scratch state so only hosts that run ahead pay for one.
+    // Breakpoints, the heat map and the disassembler don't see the frames
+    // run ahead. Returns the number of instructions executed
+    int runAhead(int frames, Chip8Frame &frame, Chip8State &present);
+
+    void pause();
+    void resume();   // continue from a pause or breakpoint
+    void step();     // execute a single instruction and stay paused
+    void stepOver(); // like step, but runs a whole subroutine call
+    bool isPaused() const { return paused; }
+    const char* getBreakReason() const { return breakReason; }
+
+    void addBreakpoint(unsigned short addr);
+    void addConditionalBreakpoint(unsigned short addr, int reg, char op, unsigned short value);
+    void removeBreakpoints(unsigned short addr);
+    bool hasBreakpoint(unsigned short addr) const;
+
+    // Pause after an FX33/FX55 writes into [addr, addr + len)
+    void addWatchpoint(unsigned short addr, unsigned short len);
+    void clearWatchpoints();
+
+    // Count reads (fetch, DXYN, FX65) and writes (FX33, FX55) per byte for
+    // the debugger's heat map, the totals travel in Chip8Frame. Like the
+    // analysis it covers the first 4K, XO-CHIP accesses above that aren't counted
+    void setHeatMap(bool on);
+    bool isHeatMapOn() const { return heatOn; }
+
 
 
 
@@ -54,11 +214,19 @@ public:
     unsigned char* getV() { return V; }
     unsigned short getI() { return I; }
     unsigned short getPC() { return pc; }
-    unsigned char getDelayTimer() { return delay_timer; }
-    unsigned char getSoundTimer() { return sound_timer; }
+    unsigned char getDelayTimer() const { return timerValue(delayStart, delaySetTick, ticksAt(cycles)); }
+    unsigned char getSoundTimer() const { return timerValue(soundStart, soundSetTick, ticksAt(cycles)); }
     unsigned char* getMemory() { return memory; }
+    unsigned char getPlanes() const { return planes; }
+
+    // XO-CHIP audio, the version moves whenever the pattern or pitch changes
+    bool hasAudioPattern() const { return patternLoaded; }
+    const unsigned char* getAudioPattern() const { return pattern; }
+    unsigned char getPitch() const { return pitch; }
+    unsigned long getAudioVersion() const { return audioVersion; }
     unsigned long getBufferSize() { return bufferSize; }
     unsigned short getSP() { return sp; }
+    unsigned short* getStack() { return stack; }
 
 
 
@@ -66,9 +234,11 @@ private:
     // -- system state variables --
     unsigned short opcode; // current opcode, two bytes long
 
-    unsigned char gfx[64 * 32]; // 64x32 pixel monochrome display, each pixel is either on(1) or off(0)
+    unsigned char gfx[64 * 32]; // 64x32 pixel display, one bit per plane: CHIP-8 pixels are either on(1) or off(0)
 
-    unsigned char memory[4096]; // 4KB memory
+    unsigned char memory[0x10000]; // 4KB memory, 64KB for XO-CHIP
+    bool xoChip = false;
+    unsigned short addrMask = 0x0FFF; // addresses wrap at the end of memory
 
     unsigned char V[16]; // 16 8-bit registers
     // ogranised from V0 to VF
@@ -82,19 +252,85 @@ private:
     System memory map:
     0x000-0x1FF - Chip 8 interpreter (contains font set in emu)
     0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
-    0x200-0xFFF - Program ROM and work RAM
+    0x200-0xFFF - Program ROM and work RAM (0x200-0xFFFF for XO-CHIP)
     */
 
-    unsigned char delay_timer; // timer that counts at 60Hz, when set above 0, it will count down to 0
-    unsigned char sound_timer; // timer that counts at 60Hz, when set above 0, it will count down to 0 and beep
+    // -- XO-CHIP --
+    unsigned char planes = 1;
+    unsigned char pitch = 64;
+    unsigned char pattern[16] = {0};
+    bool patternLoaded = false;
+    unsigned long audioVersion = 0;
+    void setAudio(const unsigned char *newPattern, unsigned char newPitch, bool loaded);
+
+    // skips step over all 4 bytes of an XO-CHIP F000 NNNN
+    unsigned short skipLength() const
+    {
+        return (xoChip && memory[(pc + 2) & addrMask] == 0xF0 && memory[(pc + 3) & addrMask] == 0x00) ? 6 : 4;
+    }
+
+    // timers that count down at 60Hz to 0, the sound timer beeps while above 0
+    // kept as the value they were set to and the tick they were set on, so
+    // nothing runs per cycle and a read works out where they are now
+    unsigned char delayStart;
+    unsigned char soundStart;
+    unsigned long long delaySetTick;
+    unsigned long long soundSetTick;
+
+    unsigned long long cycles = 0;  // emulated time, each instruction adds its cost
+    Chip8Timing timing = Chip8Timing::flat(DEFAULT_CLOCK_RATE);
+    unsigned int maxCost = 1;
+    bool nativeTiming = true;       // every cost 1 and no display wait, what chip8c counts in
+    Chip8Quirks quirks;
+
+    unsigned long long ticksAt(unsigned long long cycle) const { return cycle * 60 / timing.clockRate; }
+    unsigned long long tickStart(unsigned long long tick) const { return (tick * timing.clockRate + 59) / 60; }
+    static unsigned char timerValue(unsigned char start, unsigned long long setTick, unsigned long long tick)
+    {
+        return (tick - setTick < start) ? static_cast<unsigned char>(start - (tick - setTick)) : 0;
+    }
 
     unsigned short stack[16]; // 16 levels of stack to store return addresses when subroutines are called
     unsigned short sp;        // stack pointer
 
     unsigned char key[16]; // hex keypad with 16 keys, each key is either pressed or not pressed (1 or 0)
 
+    Chip8KeyTrace keyTrace;
+    bool tracing = false; // a traced press hasn't been drawn yet, the interpreter stamps it
+    unsigned long long traceUntil = 0; // cycle the press is given up on
+    static const unsigned int TRACE_FRAMES = 30;
+
+    void keyTested(unsigned char k)
+    {
+        if (tracing && keyTrace.observed == 0 && k == keyTrace.key && key[k]) keyTrace.observed = chip8Now();
+    }
+    void spriteDrawn(unsigned short addr, unsigned int n);
+
     long bufferSize = 0;
 
+    unsigned int rngState = 1; // xorshift32 state for CXNN, never zero
+
+    unsigned char nextRandom();
+
+    void clearScreen();
+    unsigned char drawSprite(unsigned short addr, unsigned int x, unsigned int y, unsigned int n);
+
+
+    // -- native code --
+
+    Chip8Native* nativePtr = nullptr;
+    Chip8NativeContext nativeContext;
+    bool nativeCheck = true;  // memory may not match the compiled image anymore
+    bool nativeMatch = false;
+
+    int runNative(int n);
+    static void nativeClear(void *host);
+    static unsigned char nativeDraw(void *host, unsigned short addr, unsigned int x, unsigned int y, unsigned int n);
+    static unsigned char nativeRandom(void *host);
+    static unsigned char nativeReadTimer(void *host, int sound, unsigned long long cycle);
+    static void nativeWriteTimer(void *host, int sound, unsigned long long cycle, unsigned char value);
+    static void nativeWritten(void *host, unsigned short addr, unsigned short len);
+
 
     // -- constants and fontset --
 
@@ -121,16 +357,44 @@ private:
 
 
 
-    // -- logging --
+    // -- analysis --
+
+    Chip8Disassembler* disasmPtr = nullptr;
+
+
+    // -- debugger --
+
+    bool paused = false;
+    bool debugArmed = false;     // anything armed, runCycles uses the checked loop
+    bool watchArmed = false;     // FX33/FX55 check their writes
+    bool skipBreakpoint = false; // resuming, don't stop on the current PC again
+
+    std::vector<Chip8Breakpoint> breakpoints;
+    unsigned char breakpointMap[4096] = {0}; // breakpoints per address
+    int highBreakpoints = 0;                 // XO-CHIP ones at 0x1000 and up, all together
+    unsigned long breakpointVersion = 0;     // frames copy the map when this moved
+
+    std::vector<std::pair<int, int> > watchpoints; // [start, end), end at most 0x10000
 
-    bool loggingEnabled = false;
-    Logger logger = Logger("log.jsonl");
+    bool heatOn = false;
+    unsigned int heatReads[4096];  // running totals, wrap around
+    unsigned int heatWrites[4096];
+    void heatRead(unsigned int addr)
+    {
+        addr &= addrMask;
+        if (addr < 4096) ++heatReads[addr];
+    }
 
+    int stepOverSP = -1;          // stack depth a step over returns to, -1 when idle
+    unsigned short stepOverAddr = 0;
 
-    // -- graphics --
+    char breakReason[48] = "";
 
-    // Pointer to Chip8GFX for graphics operations
-    Chip8GFX* gfxPtr = nullptr;
+    bool checkBreakpoint();
+    void markBreakpoint(unsigned short addr, int delta);
+    void memoryWritten(unsigned short addr, unsigned short len);
+    void checkWatchpoint(int addr, int len);
+    void updateArmed();
     
 };
 
@@ -0,0 +1,115 @@
+#include "chip8alloc.h"
+
+#ifdef CHIP8_ALLOC_CHECK
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+/**
+ * Allocation check - glibc's allocator behind counting malloc and operator new
+ */
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+namespace
+{
+
+// plain TLS in the executable, reading it never allocates
+thread_local const char *loopName = nullptr;
+thread_local unsigned long frames = 0;
+thread_local int allowed = 0;
+thread_local bool armed = false;
+
+void allocating(const char *what, size_t size)
+{
+    if (!armed || allowed) return;
+    armed = false; // the report itself must not trip again
+
+    char message[160];
+    const int n = snprintf(message, sizeof(message), "%s(%lu) in the %s loop, pass %lu: heap allocation in the steady state\n",
+                           what, static_cast<unsigned long>(size), loopName, frames);
+    const ssize_t written = write(STDERR_FILENO, message, n > 0 ? static_cast<size_t>(n) : 0);
+    (void)written;
+    abort();
+}
+
+} // namespace
+
+void Chip8AllocCheck::frame(const char *loop)
+{
+    loopName = loop;
+    if (++frames == WARMUP) armed = true;
+}
+
+Chip8AllocCheck::Allow::Allow()
+{
+    ++allowed;
+}
+
+Chip8AllocCheck::Allow::~Allow()
+{
+    --allowed;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    allocating("malloc", size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocating("calloc", count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocating("realloc", size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+void *operator new(size_t size)
+{
+    allocating("operator new", size);
+    void *ptr = __libc_malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    allocating("operator new[]", size);
+    void *ptr = __libc_malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocating("operator new", size);
+    return __libc_malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    allocating("operator new[]", size);
+    return __libc_malloc(size ? size : 1);
+}
+
+void operator delete(void *ptr) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr) noexcept { __libc_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { __libc_free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { __libc_free(ptr); }
+
+#endif // CHIP8_ALLOC_CHECK
@@ -0,0 +1,40 @@
+#ifndef CHIP8ALLOC_H
+#define CHIP8ALLOC_H
+
+/*
+ * Zero allocation check for the per frame loops, built in by make alloccheck
+ * (CHIP8_ALLOC_CHECK) and free otherwise.
+ *
+ * Every loop calls frame() once per pass. After WARMUP passes the calling
+ * thread is armed, and from then on any malloc, calloc, realloc or operator
+ * new it makes prints what it was and aborts, so the stack of the
+ * offending call is right there in a debugger or core dump. Events that
+ * are allowed to allocate (a restart, a control command, opening the
+ * debugger) hold an Allow for their duration.
+ */
+class Chip8AllocCheck
+{
+public:
+#ifdef CHIP8_ALLOC_CHECK
+    static void frame(const char *loop);
+
+    class Allow
+    {
+    public:
+        Allow();
+        ~Allow();
+    };
+#else
+    static void frame(const char *) {}
+
+    class Allow
+    {
+    public:
+        Allow() {}
+    };
+#endif
+
+    static const unsigned long WARMUP = 120;
+};
+
+#endif // CHIP8ALLOC_H
@@ -3,10 +3,21 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio/miniaudio.h"
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
 
 static ma_device g_device;
 static BeepState g = {48000, 440, 0, 0, 0.25f, 0};
 
+// beep_set_pattern fills a slot that is neither published nor claimed by the
+// callback, then publishes its index, -1 plays the square wave. The callback
+// claims the slot it plays and checks it is still the published one, so a
+// writer that comes after the check sees the claim and leaves that slot alone
+static BeepWave g_waves[3];
+static std::atomic<int> g_wave(-1);
+static std::atomic<int> g_playing(-1);
+
 
 
 static void recompute_step()
@@ -19,10 +30,28 @@ static void audio_cb(ma_device *dev, void *pOutput, const void * /*pInput*/, ma_
 {
     (void)dev;
     float *out = (float *)pOutput; // using ma_format_f32
+    int index = g_wave.load();
+    for (;;)
+    {
+        g_playing.store(index);
+        const int published = g_wave.load();
+        if (published == index) break;
+        index = published; // a new pattern came in between, claim that one
+    }
+    const BeepWave *wave = index >= 0 ? &g_waves[index] : nullptr;
     for (ma_uint32 i = 0; i < frameCount; ++i)
     {
-        g.phase += g.step;
-        float s = (g.phase & 0x80000000u) ? +g.amp : -g.amp; // square
+        float s;
+        if (wave)
+        {
+            g.phase += wave->step;
+            s = wave->samples[g.phase >> 25] * g.amp; // 128 samples per turn
+        }
+        else
+        {
+            g.phase += g.step;
+            s = (g.phase & 0x80000000u) ? +g.amp : -g.amp; // square
+        }
         out[i] = g.beep_on ? s : 0.0f;
     }
 }
@@ -66,6 +95,29 @@ void beep_set_freq(unsigned hz)
     recompute_step();
 }
 
+void beep_set_pattern(const unsigned char pattern[16], unsigned char pitch)
+{
+    const int published = g_wave.load();
+    const int playing = g_playing.load();
+    int next = 0;
+    while (next == published || next == playing) ++next;
+
+    BeepWave &wave = g_waves[next];
+    for (int bit = 0; bit < 128; ++bit)
+        wave.samples[bit] = (pattern[bit >> 3] & (0x80 >> (bit & 7))) ? +1.0f : -1.0f;
+
+    const double rate = 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+    wave.step = (ma_uint32)(rate / 128.0 * 4294967296.0 / (g.sr ? g.sr : 48000));
+    if (wave.step == 0) wave.step = 1;
+
+    g_wave.store(next);
+}
+
+void beep_set_square()
+{
+    g_wave.store(-1);
+}
+
 void beep_set_volume(float v /*0..1*/)
 {
     g.amp = v;
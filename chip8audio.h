@@ -9,6 +9,14 @@ struct BeepState {
     volatile int beep_on;   // set to 1 while CHIP-8 sound timer > 0
 };
 
+// XO-CHIP: the 128 one bit samples of a pattern rendered to +-1, looped MSB
+// first instead of the square wave, with the phase step that plays them at
+// the pattern's pitch. Published whole, the callback never sees one without the other
+struct BeepWave {
+    float      samples[128];
+    ma_uint32  step;        // phase step per sample, 128 samples per turn
+};
+
 // Remove this line - audio_cb is internal to chip8audio.cpp
 // static void audio_cb(ma_device *dev, void *pOutput, const void * /*pInput*/, ma_uint32 frameCount);
 
@@ -23,4 +31,9 @@ void beep_set_on(bool on);
 
 void beep_set_freq(unsigned hz);
 
+// XO-CHIP pattern at 4000*2^((pitch-64)/48) samples a second, until beep_set_square.
+// Rendered to a BeepWave here, the callback only indexes it
+void beep_set_pattern(const unsigned char pattern[16], unsigned char pitch);
+void beep_set_square();
+
 void beep_set_volume(float v);
\ No newline at end of file
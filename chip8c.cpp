@@ -0,0 +1,547 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "chip8.h"
+#include "chip8disasm.h"
+#include "chip8native.h"
+
+/**
+ * chip8c - ahead of time compiler
+ *
+ * Every instruction the disassembler can reach becomes a labelled block of
+ * C++ inside one function, jumps and skips become gotos and anything only
+ * known at runtime (RET, BNNN) goes through a switch over the compiled
+ * addresses. Whatever the native code can't do exactly like the interpreter
+ * (unknown opcodes, out of range accesses, uncompiled targets) ends the run
+ * so Chip8::runNative hands that instruction to emulateCycle.
+ */
+
+#ifndef CHIP8_INCLUDE_DIR
+#define CHIP8_INCLUDE_DIR "."
+#endif
+
+namespace
+{
+
+struct Generator
+{
+    const unsigned char *memory;
+    const Chip8Disassembler *disasm;
+    std::set<unsigned short> addrs; // compiled instruction addresses
+    std::set<unsigned short> heads; // where straight line runs start
+    std::map<unsigned short, unsigned int> fastLength; // heads with a fast run
+    FILE *out;
+
+    unsigned short opcodeAt(unsigned int a) const { return memory[a] << 8 | memory[a + 1]; }
+    bool compiled(unsigned int addr) const { return addr < 4096 && addrs.count(static_cast<unsigned short>(addr)); }
+
+    // goto the compiled instruction, or leave with pc set to it
+    void jump(unsigned int addr)
+    {
+        addr &= 0xFFFF;
+        if (compiled(addr)) fprintf(out, "    goto L%03X;\n", addr);
+        else fprintf(out, "    EXIT(0x%03X);\n", addr);
+    }
+
+    // the skip condition, or nullptr if opcode isn't a guard free skip
+    const char *skipCondition(unsigned short opcode, char *cond, size_t size) const;
+    void skip(unsigned int a, const char *cond)
+    {
+        fprintf(out, "    if (%s) ", cond);
+        if (compiled(a + 4)) fprintf(out, "goto L%03X;\n", a + 4);
+        else fprintf(out, "EXIT(0x%03X);\n", (a + 4) & 0xFFFF);
+        jump(a + 2);
+    }
+
+    // body of an instruction that can't leave early and doesn't touch the timers
+    bool simple(unsigned short opcode) const;
+    void simpleBody(unsigned short opcode);
+
+    void findHeads();
+    void instruction(unsigned int a);
+    void fastRun(unsigned int head);
+    void run();
+};
+
+const char *Generator::skipCondition(unsigned short opcode, char *cond, size_t size) const
+{
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int y = (opcode & 0x00F0) >> 4;
+    const unsigned int nn = opcode & 0x00FF;
+
+    switch (opcode & 0xF000)
+    {
+    case 0x3000: snprintf(cond, size, "V[%u] == 0x%02X", x, nn); return cond;
+    case 0x4000: snprintf(cond, size, "V[%u] != 0x%02X", x, nn); return cond;
+    case 0x5000: snprintf(cond, size, "V[%u] == V[%u]", x, y); return cond;
+    case 0x9000: snprintf(cond, size, "V[%u] != V[%u]", x, y); return cond;
+    }
+    return nullptr;
+}
+
+bool Generator::simple(unsigned short opcode) const
+{
+    switch (opcode & 0xF000)
+    {
+    case 0x0000: return opcode == 0x00E0;
+    case 0x6000: case 0x7000: case 0xA000: case 0xC000: case 0xD000: return true;
+    case 0x8000: return (opcode & 0x000F) <= 7 || (opcode & 0x000F) == 0xE;
+    case 0xF000: return (opcode & 0x00FF) == 0x1E || (opcode & 0x00FF) == 0x29;
+    }
+    return false;
+}
+
+void Generator::simpleBody(unsigned short opcode)
+{
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int y = (opcode & 0x00F0) >> 4;
+    const unsigned int n = opcode & 0x000F;
+    const unsigned int nn = opcode & 0x00FF;
+    const unsigned int nnn = opcode & 0x0FFF;
+
+    switch (opcode & 0xF000)
+    {
+    case 0x0000: fprintf(out, "    c->clear(c->host);\n"); break;
+    case 0x6000: fprintf(out, "    V[%u] = 0x%02X;\n", x, nn); break;
+    case 0x7000: fprintf(out, "    V[%u] += 0x%02X;\n", x, nn); break;
+    case 0x8000:
+        switch (n)
+        {
+        case 0x0: fprintf(out, "    V[%u] = V[%u];\n", x, y); break;
+        case 0x1: fprintf(out, "    V[%u] |= V[%u];\n", x, y); break;
+        case 0x2: fprintf(out, "    V[%u] &= V[%u];\n", x, y); break;
+        case 0x3: fprintf(out, "    V[%u] ^= V[%u];\n", x, y); break;
+        case 0x4: fprintf(out, "    { const unsigned char f = V[%u] > 0xFF - V[%u]; V[%u] += V[%u]; V[15] = f; }\n", y, x, x, y); break;
+        case 0x5: fprintf(out, "    { const unsigned char f = V[%u] >= V[%u]; V[%u] -= V[%u]; V[15] = f; }\n", x, y, x, y); break;
+        case 0x6: fprintf(out, "    V[15] = V[%u] & 1; V[%u] >>= 1;\n", x, x); break;
+        case 0x7: fprintf(out, "    { const unsigned char f = V[%u] >= V[%u]; V[%u] = V[%u] - V[%u]; V[15] = f; }\n", y, x, x, y, x); break;
+        case 0xE: fprintf(out, "    V[15] = (V[%u] & 0x80) >> 7; V[%u] <<= 1;\n", x, x); break;
+        }
+        break;
+    case 0xA000: fprintf(out, "    I = 0x%03X;\n", nnn); break;
+    case 0xC000: fprintf(out, "    V[%u] = c->random(c->host) & 0x%02X;\n", x, nn); break;
+    case 0xD000: fprintf(out, "    { const unsigned int x = V[%u], y = V[%u]; V[15] = c->draw(c->host, I, x, y, %u); }\n", x, y, n); break;
+    case 0xF000:
+        if (nn == 0x1E) fprintf(out, "    I += V[%u];\n", x);
+        else fprintf(out, "    I = V[%u] * 5;\n", x);
+        break;
+    }
+}
+
+// Branch targets and everything after an instruction a run can't go through
+void Generator::findHeads()
+{
+    char cond[64];
+    for (std::set<unsigned short>::const_iterator it = addrs.begin(); it != addrs.end(); ++it)
+    {
+        const unsigned int a = *it;
+        const unsigned short opcode = opcodeAt(a);
+
+        if (!compiled(a - 2)) heads.insert(a);
+        if ((opcode & 0xF000) == 0x1000 || (opcode & 0xF000) == 0x2000)
+        {
+            if (compiled(opcode & 0x0FFF)) heads.insert(opcode & 0x0FFF);
+        }
+        if (skipCondition(opcode, cond, sizeof(cond)) && compiled(a + 4)) heads.insert(a + 4);
+        if (!simple(opcode) && compiled(a + 2)) heads.insert(a + 2);
+    }
+}
+
+void Generator::instruction(unsigned int a)
+{
+    const unsigned short opcode = opcodeAt(a);
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int nn = opcode & 0x00FF;
+    const unsigned int nnn = opcode & 0x0FFF;
+    char cond[64];
+
+    char mnemonic[24];
+    Chip8Disassembler::disassemble(opcode, mnemonic, sizeof(mnemonic));
+    fprintf(out, "L%03X: // %s\n", a, mnemonic);
+    std::map<unsigned short, unsigned int>::const_iterator fast = fastLength.find(a);
+    if (fast != fastLength.end())
+    {
+        fprintf(out, "    if (left >= %u) { left -= %u; goto F%03X; }\n", fast->second, fast->second, a);
+    }
+
+    // guards the interpreter handles itself, checked before the cycle counts
+    switch (opcode & 0xF000)
+    {
+    case 0x0000:
+        // the interpreter wraps the stack, native code only runs inside it
+        if (opcode == 0x00EE) fprintf(out, "    if (sp == 0 || sp > 16) EXIT(0x%03X);\n", a);
+        else if (opcode != 0x00E0) { fprintf(out, "    EXIT(0x%03X);\n", a); return; }
+        break;
+    case 0x2000:
+        fprintf(out, "    if (sp >= 16) EXIT(0x%03X);\n", a);
+        break;
+    case 0x8000:
+        if (!simple(opcode)) { fprintf(out, "    EXIT(0x%03X);\n", a); return; }
+        break;
+    case 0xE000:
+        if (nn != 0x9E && nn != 0xA1) { fprintf(out, "    EXIT(0x%03X);\n", a); return; }
+        fprintf(out, "    if (V[%u] > 15) EXIT(0x%03X);\n", x, a);
+        break;
+    case 0xF000:
+        switch (nn)
+        {
+        case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29:
+            break;
+        case 0x33:
+            fprintf(out, "    if (I > 0xFFD) EXIT(0x%03X);\n", a);
+            break;
+        case 0x55:
+        case 0x65:
+            fprintf(out, "    if (I + %u > 0xFFF) EXIT(0x%03X);\n", x, a);
+            break;
+        default:
+            fprintf(out, "    EXIT(0x%03X);\n", a);
+            return;
+        }
+        break;
+    }
+    fprintf(out, "    if (left == 0) EXIT(0x%03X);\n    --left;\n", a);
+
+    if (simple(opcode))
+    {
+        simpleBody(opcode);
+        jump(a + 2);
+        return;
+    }
+    if (skipCondition(opcode, cond, sizeof(cond)))
+    {
+        skip(a, cond);
+        return;
+    }
+
+    switch (opcode & 0xF000)
+    {
+    case 0x0000: // 00EE
+        fprintf(out, "    pc = stack[--sp] + 2;\n    goto dispatch;\n");
+        return;
+    case 0x1000:
+        jump(nnn);
+        return;
+    case 0x2000:
+        fprintf(out, "    stack[sp++] = 0x%03X;\n", a);
+        jump(nnn);
+        return;
+    case 0xB000:
+        // target only known now, compiled or back to the interpreter
+        fprintf(out, "    pc = 0x%03X + V[0];\n    goto dispatch;\n", nnn);
+        return;
+    case 0xE000:
+        snprintf(cond, sizeof(cond), nn == 0x9E ? "key[V[%u]] != 0" : "key[V[%u]] == 0", x);
+        skip(a, cond);
+        return;
+    case 0xF000:
+        switch (nn)
+        {
+        case 0x07: fprintf(out, "    V[%u] = c->readTimer(c->host, 0, NOW());\n", x); break;
+        case 0x0A:
+            // keys can't change during a run, waiting uses up the whole budget
+            fprintf(out, "    {\n        int k = 0;\n        while (k < 16 && key[k] == 0) ++k;\n"
+                         "        if (k == 16) { left = 0; EXIT(0x%03X); }\n        V[%u] = k;\n    }\n", a, x);
+            break;
+        case 0x15: fprintf(out, "    c->writeTimer(c->host, 0, NOW(), V[%u]);\n", x); break;
+        case 0x18: fprintf(out, "    c->writeTimer(c->host, 1, NOW(), V[%u]);\n", x); break;
+        case 0x33:
+        case 0x55:
+        {
+            const unsigned int len = (nn == 0x33) ? 3 : x + 1;
+            if (nn == 0x33)
+                fprintf(out, "    memory[I] = V[%u] / 100; memory[I + 1] = (V[%u] / 10) %% 10; memory[I + 2] = V[%u] %% 10;\n", x, x, x);
+            else
+                fprintf(out, "    for (int i = 0; i <= %u; ++i) memory[I + i] = V[i];\n", x);
+            fprintf(out, "    c->written(c->host, I, %u);\n", len);
+            fprintf(out, "    if (touchesCode(I, %u)) { c->codeWritten = 1; EXIT(0x%03X); }\n", len, (a + 2) & 0xFFFF);
+            jump(a + 2);
+            return;
+        }
+        case 0x65: fprintf(out, "    for (int i = 0; i <= %u; ++i) V[i] = memory[I + i];\n", x); break;
+        }
+        break;
+    }
+
+    jump(a + 2);
+}
+
+// Straight line run from a head up to the next one, when the budget covers
+// all of it there are no per instruction checks
+void Generator::fastRun(unsigned int head)
+{
+    char cond[64];
+    std::vector<unsigned int> body;
+    unsigned int a = head;
+    while (compiled(a) && simple(opcodeAt(a)) && (a == head || !heads.count(a)))
+    {
+        body.push_back(a);
+        a += 2;
+    }
+
+    // a jump or skip can end the run
+    const bool endsInJump = compiled(a) && (a == head || !heads.count(a)) &&
+                            ((opcodeAt(a) & 0xF000) == 0x1000 || skipCondition(opcodeAt(a), cond, sizeof(cond)));
+    const unsigned int length = body.size() + (endsInJump ? 1 : 0);
+    if (length < 2) return;
+
+    fastLength[head] = length;
+    fprintf(out, "F%03X: // %u instructions\n", head, length);
+    for (size_t i = 0; i < body.size(); ++i)
+    {
+        simpleBody(opcodeAt(body[i]));
+    }
+
+    if (!endsInJump)
+    {
+        jump(a);
+    }
+    else if ((opcodeAt(a) & 0xF000) == 0x1000)
+    {
+        jump(opcodeAt(a) & 0x0FFF);
+    }
+    else
+    {
+        skip(a, skipCondition(opcodeAt(a), cond, sizeof(cond)));
+    }
+}
+
+void Generator::run()
+{
+    unsigned char code[512] = {0};
+    for (int a = 0; a < 4096; ++a)
+    {
+        if (disasm->isCode(a)) code[a >> 3] |= 1 << (a & 7);
+    }
+
+    const std::map<unsigned short, Chip8Disassembler::Block> &blocks = disasm->getBlocks();
+    for (std::map<unsigned short, Chip8Disassembler::Block>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        for (unsigned int a = it->second.start; a < it->second.end && a + 1 < 4096; a += 2)
+        {
+            addrs.insert(static_cast<unsigned short>(a));
+        }
+    }
+    findHeads();
+
+    fprintf(out, "// Generated by chip8c, do not edit\n#define CHIP8_NATIVE_GENERATED\n#include \"chip8native.h\"\n\n");
+
+    fprintf(out, "static const unsigned char image[4096] = {");
+    for (int a = 0; a < 4096; ++a) fprintf(out, "%s%u,", (a % 32) ? "" : "\n    ", memory[a]);
+    fprintf(out, "\n};\n\nstatic const unsigned char code[512] = {");
+    for (int i = 0; i < 512; ++i) fprintf(out, "%s%u,", (i % 32) ? "" : "\n    ", code[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out,
+            "static inline bool touchesCode(unsigned int addr, unsigned int len)\n"
+            "{\n"
+            "    for (unsigned int a = addr; a < addr + len; ++a)\n"
+            "        if (code[a >> 3] >> (a & 7) & 1) return true;\n"
+            "    return false;\n"
+            "}\n\n"
+            "// cycle of the instruction being executed, what the timers are read and set against\n"
+            "#define NOW() (c->cycle + (cycles - left))\n"
+            "#define EXIT(a) do { pc = (a); goto out; } while (0)\n\n"
+            "extern \"C\" int chip8_native_abi() { return CHIP8_NATIVE_ABI; }\n"
+            "extern \"C\" const unsigned char *chip8_native_image() { return image; }\n"
+            "extern \"C\" const unsigned char *chip8_native_code() { return code; }\n\n"
+            "extern \"C\" int chip8_native_run(Chip8NativeContext *c, int cycles)\n"
+            "{\n"
+            "    unsigned char *const memory = c->memory;\n"
+            "    unsigned short *const stack = c->stack;\n"
+            "    const unsigned char *const key = c->key;\n"
+            "    unsigned char V[16];\n"
+            "    for (int i = 0; i < 16; ++i) V[i] = c->V[i];\n"
+            "    unsigned short I = *c->I, pc = *c->pc, sp = *c->sp;\n"
+
+            "    int left = cycles;\n\n"
+            "dispatch:\n"
+            "    switch (pc)\n"
+            "    {\n");
+    for (std::set<unsigned short>::const_iterator it = addrs.begin(); it != addrs.end(); ++it)
+    {
+        fprintf(out, "    case 0x%03X: goto L%03X;\n", *it, *it);
+    }
+    fprintf(out, "    default: goto out;\n    }\n\n");
+
+    // fast runs first, the checked instructions jump into them
+    for (std::set<unsigned short>::const_iterator it = heads.begin(); it != heads.end(); ++it)
+    {
+        fastRun(*it);
+    }
+    fprintf(out, "\n");
+    for (std::set<unsigned short>::const_iterator it = addrs.begin(); it != addrs.end(); ++it)
+    {
+        instruction(*it);
+    }
+
+    fprintf(out,
+            "\nout:\n"
+            "    for (int i = 0; i < 16; ++i) c->V[i] = V[i];\n"
+            "    *c->I = I;\n"
+            "    *c->pc = pc;\n"
+            "    *c->sp = sp;\n"
+
+            "    return cycles - left;\n"
+            "}\n");
+}
+
+bool sameState(const Chip8State &a, const Chip8State &b, const char *&field)
+{
+    field = a.memorySize != b.memorySize || memcmp(a.memory, b.memory, a.memorySize) ? "memory"
+          : memcmp(a.gfx, b.gfx, sizeof(a.gfx)) ? "display"
+          : memcmp(a.V, b.V, sizeof(a.V)) ? "V"
+          : memcmp(a.stack, b.stack, sizeof(a.stack)) ? "stack"
+          : a.I != b.I ? "I"
+          : a.pc != b.pc ? "PC"
+          : a.sp != b.sp ? "SP"
+          : a.delay_timer != b.delay_timer ? "DT"
+          : a.sound_timer != b.sound_timer ? "ST"
+          : a.rngState != b.rngState ? "RNG"
+          : a.cycles != b.cycles ? "cycles"
+          : nullptr;
+    return field == nullptr;
+}
+
+// Run the ROM through the interpreter and the native code side by side
+bool verify(Chip8Native &native, const unsigned char *rom, long romSize, long cycles)
+{
+    static Chip8 interpreted, compiled;
+    interpreted.initialize();
+    compiled.initialize();
+    interpreted.loadROM(rom, romSize);
+    compiled.loadROM(rom, romSize);
+    interpreted.seedRandom(1);
+    compiled.seedRandom(1);
+    compiled.setNative(&native);
+
+    using clock = std::chrono::steady_clock;
+    clock::duration interpretedTime(0), compiledTime(0);
+
+    const int BATCH = 1000;
+    static Chip8State a, b;
+    for (long done = 0; done < cycles; done += BATCH)
+    {
+        clock::time_point t0 = clock::now();
+        interpreted.runCycles(BATCH);
+        clock::time_point t1 = clock::now();
+        compiled.runCycles(BATCH);
+        compiledTime += clock::now() - t1;
+        interpretedTime += t1 - t0;
+
+        interpreted.saveState(a);
+        compiled.saveState(b);
+        const char *field;
+        if (!sameState(a, b, field))
+        {
+            std::cerr << "Native code diverged from the interpreter in " << field << " within cycles "
+                      << done << "-" << done + BATCH << std::endl;
+            return false;
+        }
+    }
+
+    const double ti = std::chrono::duration<double>(interpretedTime).count();
+    const double tc = std::chrono::duration<double>(compiledTime).count();
+    printf("Verified %ld cycles: interpreter %.1f Mcycles/s, native %.1f Mcycles/s (%.1fx)\n",
+           cycles, cycles / ti / 1e6, cycles / tc / 1e6, ti / tc);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char *gamePath = nullptr;
+    std::string outPath;
+    long verifyCycles = 1000000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "-o" && i + 1 < argc)
+            outPath = argv[++i];
+        else if (arg == "--verify" && i + 1 < argc)
+            verifyCycles = std::strtol(argv[++i], nullptr, 10);
+        else if (!gamePath)
+            gamePath = argv[i];
+        else
+        {
+            gamePath = nullptr;
+            break;
+        }
+    }
+
+    if (!gamePath)
+    {
+        std::cout << "Usage: ./chip8c [-o <out.so>] [--verify <cycles>] <gamePath>\n";
+        return 0;
+    }
+    if (outPath.empty()) outPath = std::string(gamePath) + ".so";
+
+    static unsigned char rom[4096 - 0x200];
+    FILE *file = fopen(gamePath, "rb");
+    if (file == nullptr)
+    {
+        std::perror("Error opening file for reading");
+        return 1;
+    }
+    const long romSize = static_cast<long>(fread(rom, 1, sizeof(rom), file));
+    const bool tooLarge = fgetc(file) != EOF; // compiled code covers the first 4K only
+    fclose(file);
+    if (tooLarge)
+    {
+        std::cerr << gamePath << ": ROM too large, at most " << sizeof(rom) << " bytes" << std::endl;
+        return 1;
+    }
+
+    // the same memory the emulator starts with, fontset included
+    static Chip8 chip8;
+    chip8.initialize();
+    chip8.loadROM(rom, romSize);
+
+    Chip8Disassembler disasm;
+    disasm.analyze(chip8.getMemory(), romSize);
+
+    // generate next to the output, the source is kept for inspection
+    const std::string sourcePath = outPath + ".cpp";
+    Generator generator;
+    generator.memory = chip8.getMemory();
+    generator.disasm = &disasm;
+    generator.out = fopen(sourcePath.c_str(), "w");
+    if (generator.out == nullptr)
+    {
+        std::perror("Error opening output");
+        return 1;
+    }
+    generator.run();
+    fclose(generator.out);
+    printf("%s: %zu instructions compiled\n", sourcePath.c_str(), generator.addrs.size());
+
+    const char *cxx = getenv("CXX");
+    const std::string command = std::string(cxx ? cxx : "c++") + " -O2 -std=c++11 -shared -fPIC -I\"" CHIP8_INCLUDE_DIR "\" -o \"" +
+                                outPath + "\" \"" + sourcePath + "\"";
+    if (system(command.c_str()) != 0)
+    {
+        std::cerr << "Failed to build " << outPath << std::endl;
+        return 1;
+    }
+
+    Chip8Native native;
+    if (!native.load(outPath.c_str()))
+    {
+        return 1;
+    }
+    if (verifyCycles > 0 && !verify(native, rom, romSize, verifyCycles))
+    {
+        return 1;
+    }
+
+    printf("%s written\n", outPath.c_str());
+    return 0;
+}
@@ -0,0 +1,269 @@
+#include "chip8capture.h"
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <chrono>
+
+/**
+ * Capture - the emulator side only queues data, the worker thread packs,
+ * deduplicates and run length encodes frames and synthesizes the beeper.
+ */
+
+namespace
+{
+
+void putVarint(FILE *file, unsigned long long v)
+{
+    while (v >= 0x80)
+    {
+        fputc(static_cast<int>(v & 0x7F) | 0x80, file);
+        v >>= 7;
+    }
+    fputc(static_cast<int>(v), file);
+}
+
+void put16(FILE *file, unsigned int v)
+{
+    fputc(v & 0xFF, file);
+    fputc((v >> 8) & 0xFF, file);
+}
+
+void put32(FILE *file, unsigned int v)
+{
+    put16(file, v & 0xFFFF);
+    put16(file, v >> 16);
+}
+
+} // namespace
+
+Chip8Capture::~Chip8Capture()
+{
+    stop();
+}
+
+bool Chip8Capture::start(const char *basePath, bool waitWhenFull)
+{
+    if (active) return true;
+    this->waitWhenFull = waitWhenFull;
+
+    std::string base(basePath);
+    video = fopen((base + ".c8v").c_str(), "wb");
+    wav = fopen((base + ".wav").c_str(), "wb");
+    if (video == nullptr || wav == nullptr)
+    {
+        std::perror("Error opening capture files");
+        if (video) fclose(video);
+        if (wav) fclose(wav);
+        video = wav = nullptr;
+        return false;
+    }
+
+    // video header
+    fwrite("C8V1", 1, 4, video);
+    put16(video, 64);
+    put16(video, 32);
+    put16(video, 60);
+
+    // wav header, sizes are patched in finishWav
+    fwrite("RIFF", 1, 4, wav);
+    put32(wav, 0);
+    fwrite("WAVEfmt ", 1, 8, wav);
+    put32(wav, 16);
+    put16(wav, 1);               // PCM
+    put16(wav, 1);               // mono
+    put32(wav, SAMPLE_RATE);
+    put32(wav, SAMPLE_RATE * 2); // byte rate
+    put16(wav, 2);               // block align
+    put16(wav, 16);              // bits per sample
+    fwrite("data", 1, 4, wav);
+    put32(wav, 0);
+
+    memset(lastFrame, 0, sizeof(lastFrame));
+    ticks = lastTick = 0;
+    framesWritten = framesSkipped = samplesWritten = 0;
+    droppedFrames = droppedEdges = 0;
+    beeping = audioOn = false;
+    audioTick = 0;
+    phase = 0;
+
+    running = true;
+    active = true;
+    worker = std::thread(&Chip8Capture::run, this);
+    return true;
+}
+
+void Chip8Capture::stop()
+{
+    if (!active) return;
+
+    running = false;
+    wake.notify_one();
+    worker.join();
+    active = false;
+
+    // the beeper state holds until the last tick
+    writeAudioUntil(ticks);
+    finishWav();
+    fclose(video);
+    video = nullptr;
+
+    std::cout << "Capture: " << framesWritten << " frames written, " << framesSkipped << " duplicates skipped, "
+              << ticks << " ticks";
+    if (droppedFrames || droppedEdges)
+        std::cout << " (dropped " << droppedFrames << " frames, " << droppedEdges << " beeper changes, worker too slow)";
+    std::cout << std::endl;
+}
+
+void Chip8Capture::tick(bool beeping)
+{
+    if (!active) return;
+
+    if (beeping != this->beeping)
+    {
+        BeepEdge edge = {ticks, beeping};
+        if (enqueue(audio, edge))
+            this->beeping = beeping;
+        else
+            droppedEdges++;
+    }
+    ticks++;
+}
+
+void Chip8Capture::submitFrame(const unsigned char *gfx)
+{
+    if (!active) return;
+
+    pending.tick = ticks;
+    memcpy(pending.pixels, gfx, sizeof(pending.pixels));
+    if (!enqueue(frames, pending))
+    {
+        droppedFrames++;
+    }
+}
+
+template <typename T, size_t N>
+bool Chip8Capture::enqueue(Chip8Ring<T, N> &ring, const T &item)
+{
+    while (!ring.push(item))
+    {
+        if (!waitWhenFull) return false;
+        wake.notify_one();
+        std::this_thread::yield();
+    }
+    wake.notify_one();
+    return true;
+}
+
+void Chip8Capture::run()
+{
+    while (running)
+    {
+        drain();
+
+        // the emulator never takes this lock, a missed notify only costs one timeout
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::milliseconds(5));
+    }
+    drain();
+}
+
+void Chip8Capture::drain()
+{
+    Frame frame;
+    BeepEdge edge;
+    bool busy = true;
+    while (busy)
+    {
+        busy = false;
+        while (audio.pop(edge))
+        {
+            writeAudioUntil(edge.tick);
+            audioOn = edge.on;
+            busy = true;
+        }
+        while (frames.pop(frame))
+        {
+            encodeFrame(frame);
+            busy = true;
+        }
+    }
+}
+
+void Chip8Capture::encodeFrame(const Frame &frame)
+{
+    // pack to 1 bit per pixel, lit in either XO-CHIP plane counts as on
+    unsigned char packed[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        unsigned int bits = 0;
+        for (int b = 0; b < 8; ++b) bits = bits << 1 | (frame.pixels[i * 8 + b] != 0);
+        packed[i] = bits;
+    }
+
+    const bool keyframe = framesWritten % KEYFRAME_INTERVAL == 0;
+    if (!keyframe && memcmp(packed, lastFrame, sizeof(packed)) == 0)
+    {
+        framesSkipped++;
+        return;
+    }
+
+    unsigned char diff[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        diff[i] = keyframe ? packed[i] : packed[i] ^ lastFrame[i];
+    }
+
+    putVarint(video, frame.tick - lastTick);
+    fputc(keyframe ? 1 : 2, video);
+
+    // zero runs and literal runs
+    int i = 0;
+    while (i < 256)
+    {
+        int zeros = 0;
+        while (i + zeros < 256 && diff[i + zeros] == 0) zeros++;
+        int literals = 0;
+        while (i + zeros + literals < 256 && diff[i + zeros + literals] != 0) literals++;
+
+        putVarint(video, zeros);
+        putVarint(video, literals);
+        fwrite(diff + i + zeros, 1, literals, video);
+        i += zeros + literals;
+    }
+
+    memcpy(lastFrame, packed, sizeof(packed));
+    lastTick = frame.tick;
+    framesWritten++;
+}
+
+// Write 440Hz square wave or silence, one 60Hz tick at a time, up to tick
+void Chip8Capture::writeAudioUntil(unsigned long long tick)
+{
+    const unsigned int step = static_cast<unsigned int>(440ull * 0x100000000ull / SAMPLE_RATE);
+    const int samples = SAMPLE_RATE / 60;
+    unsigned char buffer[SAMPLE_RATE / 60 * 2];
+
+    for (; audioTick < tick; ++audioTick)
+    {
+        for (int i = 0; i < samples; ++i)
+        {
+            phase += step;
+            const short s = audioOn ? ((phase & 0x80000000u) ? 8000 : -8000) : 0;
+            buffer[i * 2] = s & 0xFF;
+            buffer[i * 2 + 1] = (s >> 8) & 0xFF;
+        }
+        fwrite(buffer, 1, sizeof(buffer), wav);
+        samplesWritten += samples;
+    }
+}
+
+void Chip8Capture::finishWav()
+{
+    const unsigned int dataBytes = static_cast<unsigned int>(samplesWritten * 2);
+    fseek(wav, 4, SEEK_SET);
+    put32(wav, 36 + dataBytes);
+    fseek(wav, 40, SEEK_SET);
+    put32(wav, dataBytes);
+    fclose(wav);
+    wav = nullptr;
+}
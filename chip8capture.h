@@ -0,0 +1,100 @@
+#ifndef CHIP8CAPTURE_H
+#define CHIP8CAPTURE_H
+
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "chip8ring.h"
+
+/*
+ * Records the emulator output to <base>.c8v (video) and <base>.wav (beeper).
+ *
+ * The emulator thread only copies frames and beeper states into lock free
+ * queues, encoding and file IO happen on a background thread. Everything
+ * is stamped with emulated 60Hz timer ticks rather than wall clock time,
+ * so headless runs record at whatever speed they run.
+ *
+ * .c8v format, little endian:
+ *   header  "C8V1", u16 width (64), u16 height (32), u16 ticks per second (60)
+ *   frames  varint tick delta since the previous frame
+ *           u8 type: 1 = keyframe (against a blank frame), 2 = delta (against the previous frame)
+ *           runs over the 256 byte packed frame (1 bit per pixel, MSB first) XORed with
+ *           the reference: varint zero byte count, varint literal count, literal bytes,
+ *           repeated until all 256 bytes are covered
+ * Frames identical to the previous one are not stored, the next tick delta covers them.
+ */
+class Chip8Capture
+{
+public:
+    ~Chip8Capture();
+
+    // waitWhenFull makes the emulator wait for the worker instead of
+    // dropping data, for headless runs where nothing is real time
+    bool start(const char *basePath, bool waitWhenFull = false);
+    void stop();
+    bool isActive() const { return active; }
+
+    // One 60Hz emulated timer tick, with the beeper state during it
+    void tick(bool beeping);
+
+    // A frame was presented, stamped with the current tick
+    void submitFrame(const unsigned char *gfx);
+
+private:
+    struct Frame
+    {
+        unsigned long long tick;
+        unsigned char pixels[64 * 32];
+    };
+
+    // the beeper only travels to the worker when it switches
+    struct BeepEdge
+    {
+        unsigned long long tick;
+        bool on;
+    };
+
+    static const int SAMPLE_RATE = 44100;
+    static const int KEYFRAME_INTERVAL = 300;
+
+    bool active = false;
+    bool waitWhenFull = false;
+    unsigned long long ticks = 0;
+    unsigned long droppedFrames = 0;
+    unsigned long droppedEdges = 0;
+    bool beeping = false;
+
+    // emulator -> worker
+    Chip8Ring<Frame, 256> frames;
+    Chip8Ring<BeepEdge, 1024> audio;
+    Frame pending; // staging copy, keeps the ring push off the stack
+
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    // -- worker state --
+    FILE *video = nullptr;
+    FILE *wav = nullptr;
+    unsigned char lastFrame[256];
+    unsigned long long lastTick = 0;
+    unsigned long framesWritten = 0;
+    unsigned long framesSkipped = 0;
+    unsigned long samplesWritten = 0;
+    unsigned long long audioTick = 0;
+    bool audioOn = false;
+    unsigned int phase = 0;
+
+    template <typename T, size_t N>
+    bool enqueue(Chip8Ring<T, N> &ring, const T &item);
+    void run();
+    void drain();
+    void encodeFrame(const Frame &frame);
+    void writeAudioUntil(unsigned long long tick);
+    void finishWav();
+};
+
+#endif // CHIP8CAPTURE_H
@@ -0,0 +1,382 @@
+#include "chip8control.h"
+#include "chip8alloc.h"
+#include "chip8disasm.h"
+#include "chip8quirks.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Control server - see chip8control.h for the wire format
+ */
+
+namespace
+{
+
+// What one client can make the core thread do, it renders nothing meanwhile
+const size_t MAX_MESSAGE = 1 << 20;
+const size_t MAX_REPLY = 1 << 20;          // per request, 0x06 and 0x07 add up
+const size_t MAX_PENDING = 4 << 20;        // unsent replies, a client that doesn't read isn't read either
+const unsigned int MAX_CYCLES = 1000000;   // per request, 0x02 and 0x0C together
+const unsigned long MAX_POLL_CYCLES = 4000000ul; // a request only starts with MAX_CYCLES of this left
+const int MAX_POLL_REQUESTS = 256;         // the rest wait in the client's buffer for the next poll
+
+// Bounds checked little endian reader over one request
+struct Reader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    bool ok;
+
+    bool need(size_t n)
+    {
+        ok = ok && static_cast<size_t>(end - p) >= n;
+        return ok;
+    }
+    unsigned int u8() { if (!need(1)) return 0; return *p++; }
+    unsigned int u16() { if (!need(2)) return 0; unsigned int v = p[0] | p[1] << 8; p += 2; return v; }
+    unsigned int u32()
+    {
+        if (!need(4)) return 0;
+        unsigned int v = p[0] | p[1] << 8 | p[2] << 16 | static_cast<unsigned int>(p[3]) << 24;
+        p += 4;
+        return v;
+    }
+};
+
+void put8(std::vector<unsigned char> &out, unsigned int v) { out.push_back(v & 0xFF); }
+void put16(std::vector<unsigned char> &out, unsigned int v) { put8(out, v); put8(out, v >> 8); }
+void put32(std::vector<unsigned char> &out, unsigned int v) { put16(out, v); put16(out, v >> 16); }
+
+enum Status { OK = 0, BAD_ARGS = 1, UNKNOWN = 2 };
+
+} // namespace
+
+Chip8ControlServer::Chip8ControlServer(Chip8* chip8) : chip8(chip8)
+{
+}
+
+Chip8ControlServer::~Chip8ControlServer()
+{
+    close();
+}
+
+bool Chip8ControlServer::open(const char *path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Control socket path too long" << std::endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        std::perror("socket");
+        return false;
+    }
+
+    unlink(path); // stale socket from a previous run
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listenFd, 8) != 0)
+    {
+        std::perror("Control socket");
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+    socketPath = path;
+    return true;
+}
+
+void Chip8ControlServer::close()
+{
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        ::close(clients[i].fd);
+    }
+    clients.clear();
+
+    if (listenFd >= 0)
+    {
+        ::close(listenFd);
+        unlink(socketPath.c_str());
+        listenFd = -1;
+    }
+}
+
+void Chip8ControlServer::poll()
+{
+    if (listenFd < 0) return;
+    Chip8AllocCheck::Allow allow; // clients and their requests are events, not the frame loop
+    pollCycles = MAX_POLL_CYCLES;
+    pollRequests = MAX_POLL_REQUESTS;
+
+    // new connections
+    int fd;
+    while ((fd = accept(listenFd, nullptr, nullptr)) >= 0)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        Client client;
+        client.fd = fd;
+        clients.push_back(client);
+    }
+
+    for (size_t i = 0; i < clients.size();)
+    {
+        if (readClient(clients[i]) && writeClient(clients[i]))
+        {
+            ++i;
+            continue;
+        }
+        ::close(clients[i].fd);
+        clients.erase(clients.begin() + i);
+    }
+}
+
+bool Chip8ControlServer::readClient(Client &client)
+{
+    // one whole message ahead at most, and nothing while replies pile up
+    unsigned char buffer[4096];
+    while (client.in.size() < MAX_MESSAGE + 4 && client.out.size() < MAX_PENDING)
+    {
+        const ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            client.in.insert(client.in.end(), buffer, buffer + n);
+            continue;
+        }
+        if (n == 0) return false; // closed
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        if (errno == EINTR) continue;
+        return false;
+    }
+
+    // answer complete requests while this poll's budget lasts
+    size_t pos = 0;
+    while (client.in.size() - pos >= 4 && client.out.size() < MAX_PENDING &&
+           pollRequests > 0 && pollCycles >= MAX_CYCLES)
+    {
+        const unsigned char *h = &client.in[pos];
+        const size_t length = h[0] | h[1] << 8 | h[2] << 16 | static_cast<size_t>(h[3]) << 24;
+        if (length > MAX_MESSAGE) return false;
+        if (client.in.size() - pos - 4 < length) break;
+
+        std::vector<unsigned char> reply;
+        handleRequest(h + 4, length, reply);
+        --pollRequests;
+
+        put32(client.out, static_cast<unsigned int>(reply.size()));
+        client.out.insert(client.out.end(), reply.begin(), reply.end());
+        pos += 4 + length;
+    }
+    client.in.erase(client.in.begin(), client.in.begin() + pos);
+    return true;
+}
+
+bool Chip8ControlServer::writeClient(Client &client)
+{
+    size_t sent = 0;
+    while (sent < client.out.size())
+    {
+        const ssize_t n = send(client.fd, &client.out[sent], client.out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break; // rest goes out next poll
+        return false;
+    }
+    client.out.erase(client.out.begin(), client.out.begin() + sent);
+    return true;
+}
+
+void Chip8ControlServer::setHost(Chip8State *bootState, Chip8Rewind *history)
+{
+    this->bootState = bootState;
+    this->history = history;
+}
+
+void Chip8ControlServer::handleRequest(const unsigned char *data, size_t size, std::vector<unsigned char> &reply)
+{
+    Reader in = {data, data + size, true};
+    unsigned int cycles = MAX_CYCLES; // left for this request
+
+    while (in.p < in.end)
+    {
+        const unsigned int op = in.u8();
+        const size_t statusPos = reply.size();
+        put8(reply, OK);
+        if (reply.size() > MAX_REPLY)
+        {
+            reply[statusPos] = BAD_ARGS;
+            return;
+        }
+
+        switch (op)
+        {
+        case 0x01: // load ROM
+        {
+            const unsigned int romSize = in.u32();
+            if (!in.need(romSize))
+            {
+                break;
+            }
+            // checks the size before anything is reset, a ROM that doesn't fit changes nothing
+            if (!chip8->reloadROM(in.p, romSize, nullptr, false))
+            {
+                in.ok = false;
+                break;
+            }
+            if (autoQuirks)
+            {
+                chip8->setQuirks(Chip8QuirkDetect::detect(in.p, romSize, chip8->isXOChip(), chip8->getTiming()).quirks);
+            }
+            in.p += romSize;
+            if (chip8->getDisassembler())
+            {
+                chip8->getDisassembler()->analyze(chip8->getMemory(), chip8->getBufferSize());
+            }
+            if (bootState) chip8->saveState(*bootState);
+            if (history) history->clear(); // older frames would bring the old ROM back
+            break;
+        }
+        case 0x02: // step, runs even while real time execution is paused
+        {
+            const unsigned int steps = in.u32();
+            if (steps > cycles) in.ok = false;
+            if (!in.ok) break;
+            for (unsigned int i = 0; i < steps; ++i)
+            {
+                chip8->emulateCycle();
+            }
+            cycles -= steps;
+            pollCycles -= steps;
+            put32(reply, steps);
+            break;
+        }
+        case 0x03: // tick timers
+        {
+            const unsigned int ticks = in.u16();
+            if (in.ok) chip8->tickTimers(ticks);
+            break;
+        }
+        case 0x04: // set keys
+        {
+            const unsigned int mask = in.u16();
+            for (int k = 0; in.ok && k < 16; ++k)
+            {
+                chip8->setKey(k, (mask >> k) & 1);
+            }
+            break;
+        }
+        case 0x05: // read registers
+        {
+            // straight from the machine, a saved state would be 64K on the stack for 56 bytes
+            const unsigned char *V = chip8->getV();
+            reply.insert(reply.end(), V, V + 16);
+            put16(reply, chip8->getI());
+            put16(reply, chip8->getPC());
+            put16(reply, chip8->getSP());
+            put8(reply, chip8->getDelayTimer());
+            put8(reply, chip8->getSoundTimer());
+            const unsigned short *stack = chip8->getStack();
+            for (int i = 0; i < 16; ++i) put16(reply, stack[i]);
+            break;
+        }
+        case 0x06: // read memory
+        {
+            const unsigned int addr = in.u16();
+            const unsigned int len = in.u16();
+            if (!in.ok) break;
+            const unsigned char *memory = chip8->getMemory();
+            const unsigned int mask = chip8->isXOChip() ? 0xFFFF : 0x0FFF;
+            for (unsigned int i = 0; i < len; ++i)
+            {
+                put8(reply, memory[(addr + i) & mask]);
+            }
+            break;
+        }
+        case 0x07: // framebuffer, packed, a pixel in either XO-CHIP plane is on
+        {
+            const unsigned char *gfx = chip8->getDisplayBuffer();
+            for (int i = 0; i < 64 * 32; i += 8)
+            {
+                unsigned int bits = 0;
+                for (int b = 0; b < 8; ++b) bits = bits << 1 | (gfx[i + b] != 0);
+                put8(reply, bits);
+            }
+            break;
+        }
+        case 0x08: // save state
+        case 0x09: // restore state
+        {
+            const unsigned int slot = in.u8();
+            if (!in.ok || slot >= SLOTS || (op == 0x09 && !slotUsed[slot]))
+            {
+                in.ok = false;
+                break;
+            }
+            if (op == 0x08)
+            {
+                chip8->saveState(slots[slot]);
+                slotUsed[slot] = true;
+            }
+            else
+            {
+                chip8->loadState(slots[slot]);
+                chip8->drawFlag = true;
+            }
+            break;
+        }
+        case 0x0A:
+            chip8->pause();
+            break;
+        case 0x0B:
+            chip8->resume();
+            break;
+        case 0x0C: // whole frames of emulated time, also ignores the pause
+        {
+            const unsigned int frames = in.u16();
+            if (!in.ok) break;
+            // stops early once the request's cycles are spent, the result says how far it got
+            unsigned int executed = 0;
+            for (unsigned int f = 0; f < frames && executed < cycles; ++f)
+            {
+                const unsigned long long end = chip8->getCycles() + chip8->cyclesToNextTick();
+                while (chip8->getCycles() < end && executed < cycles)
+                {
+                    chip8->emulateCycle();
+                    ++executed;
+                }
+            }
+            cycles -= executed;
+            pollCycles -= executed;
+            put32(reply, executed);
+            break;
+        }
+        default:
+            reply[statusPos] = UNKNOWN;
+            return;
+        }
+
+        if (!in.ok)
+        {
+            // arguments are missing or wrong, we can't find the next command
+            reply[statusPos] = BAD_ARGS;
+            return;
+        }
+    }
+}
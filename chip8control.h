@@ -0,0 +1,87 @@
+#ifndef CHIP8CONTROL_H
+#define CHIP8CONTROL_H
+
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "chip8rewind.h"
+
+/*
+ * Local control server on a Unix domain socket, for driving the emulator
+ * from scripts and test harnesses.
+ *
+ * Every message is a little endian u32 payload length followed by the
+ * payload. A request payload is any number of commands back to back, so a
+ * single round trip can step and observe in bulk. The reply payload holds
+ * one result per command, in order, each starting with a status byte
+ * (0 = ok, 1 = bad arguments, 2 = unknown command, the rest is skipped).
+ * A request runs at most 1M cycles across its 0x02 and 0x0C commands and
+ * replies with at most 1 MiB; past either the command fails as bad arguments.
+ * Each poll answers a bounded number of requests, the rest wait for the next.
+ *
+ *   op   arguments                 result after the status byte
+ *   0x01 u32 size, size bytes      -                 reset and load a ROM, ESC restarts it from now on,
+ *                                                    with --quirks auto its profile is detected first
+ *   0x02 u32 cycles                u32 executed      run cycles (ignores pause)
+ *   0x03 u16 ticks                 -                 move the 60Hz timers on without running
+ *   0x04 u16 key mask              -                 bit n = key n pressed
+ *   0x05 -                         V[16], u16 I, u16 PC, u16 SP, u8 DT, u8 ST, u16 stack[16]
+ *   0x06 u16 addr, u16 len         len bytes         read memory (wraps at 4K, 64K for XO-CHIP)
+ *   0x07 -                         256 bytes         framebuffer, 1 bit per pixel, MSB first
+ *   0x08 u8 slot                   -                 save state into slot 0-7
+ *   0x09 u8 slot                   -                 restore state from slot 0-7
+ *   0x0A -                         -                 pause real time execution
+ *   0x0B -                         -                 resume real time execution
+ *   0x0C u16 frames                u32 executed      run whole 60Hz frames of emulated time (ignores pause,
+ *                                                    stops early where the request's cycles run out)
+ */
+class Chip8ControlServer
+{
+public:
+    Chip8ControlServer(Chip8* chip8);
+    ~Chip8ControlServer();
+
+    // Listen on the given socket path, replaces a stale socket file
+    bool open(const char *path);
+    void close();
+
+    // Accept clients and answer complete requests, never blocks
+    void poll();
+
+    // What the host restarts from and rewinds through, a ROM loaded over the
+    // socket replaces the one and clears the other. Either may be nullptr
+    void setHost(Chip8State *bootState, Chip8Rewind *history);
+
+    // A ROM loaded over the socket gets its quirk profile detected, as at startup
+    void setAutoQuirks(bool on) { autoQuirks = on; }
+
+private:
+    struct Client
+    {
+        int fd;
+        std::vector<unsigned char> in;
+        std::vector<unsigned char> out;
+    };
+
+    Chip8* chip8;
+    Chip8State *bootState = nullptr;
+    Chip8Rewind *history = nullptr;
+    bool autoQuirks = false;
+
+    int listenFd = -1;
+    std::string socketPath;
+    std::vector<Client> clients;
+    unsigned long pollCycles = 0; // left in the current poll
+    int pollRequests = 0;
+
+    static const int SLOTS = 8;
+    Chip8State slots[SLOTS];
+    bool slotUsed[SLOTS] = {false};
+
+    // returns false if the client sent garbage and should be dropped
+    bool readClient(Client &client);
+    bool writeClient(Client &client);
+    void handleRequest(const unsigned char *data, size_t size, std::vector<unsigned char> &reply);
+};
+
+#endif // CHIP8CONTROL_H
@@ -0,0 +1,59 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "chip8disasm.h"
+
+// Stand-alone disassembler, prints the listing of a ROM with its basic blocks
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cout << "Usage: ./chip8dis <gamePath>\n";
+        return 0;
+    }
+
+    static unsigned char memory[4096] = {0};
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == nullptr)
+    {
+        std::perror("Error opening file for reading");
+        return 1;
+    }
+    const long romSize = static_cast<long>(fread(memory + 0x200, 1, sizeof(memory) - 0x200, file));
+    fclose(file);
+
+    Chip8Disassembler disasm;
+    disasm.analyze(memory, romSize);
+
+    std::vector<Chip8Disassembler::Line> lines;
+    disasm.buildListing(lines);
+
+    char buffer[32];
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        const Chip8Disassembler::Line &line = lines[i];
+
+        // label every block with where it can go next
+        const Chip8Disassembler::Block *block = disasm.blockAt(line.addr);
+        if (line.code && block && block->start == line.addr)
+        {
+            printf("\nL%03X:", line.addr);
+            if (!block->successors.empty())
+            {
+                printf("  ; ->");
+                for (size_t s = 0; s < block->successors.size(); ++s)
+                    printf(" %03X", block->successors[s]);
+            }
+            if (block->indirect) printf("  ; -> V0 + %03X", (memory[block->end - 2] << 8 | memory[block->end - 1]) & 0x0FFF);
+            if (block->returns) printf("  ; return");
+            printf("\n");
+        }
+
+        disasm.formatLine(line, buffer, sizeof(buffer));
+        printf("    %s\n", buffer);
+    }
+
+    return 0;
+}
@@ -0,0 +1,350 @@
+#include "chip8disasm.h"
+#include "chip8alloc.h"
+#include <cstdio>
+#include <cstring>
+
+/**
+ * Recursive descent disassembler - blocks are walked from a worklist of
+ * branch targets, so only bytes the program can actually reach are treated
+ * as code. Everything else in the ROM is listed as data.
+ */
+
+void Chip8Disassembler::analyze(const unsigned char *memory, long romSize, unsigned short entry)
+{
+    this->memory = memory;
+    romEnd = (0x200 + romSize < 4096) ? 0x200 + romSize : 4096;
+
+    blocks.clear();
+    memset(codeMap, 0, sizeof(codeMap));
+
+    std::vector<unsigned short> worklist(1, entry);
+    explore(worklist);
+
+    ++version;
+}
+
+void Chip8Disassembler::memoryWritten(unsigned short addr, unsigned short len)
+{
+    if (memory == nullptr) return;
+
+    const unsigned int last = (addr + len < 4096u) ? addr + len : 4096u;
+
+    bool hitsCode = false;
+    for (unsigned int a = addr; a < last; ++a)
+    {
+        hitsCode |= codeMap[a];
+    }
+
+    if (!hitsCode)
+    {
+        // plain data, only the listing text changes
+        if (addr < romEnd && last > 0x200) ++version;
+        return;
+    }
+
+    // drop every block the write touched and walk them again from their start,
+    // rebuilding blocks allocates but only happens when code is rewritten
+    Chip8AllocCheck::Allow allow;
+    std::vector<unsigned short> worklist;
+    unsigned int lo = last, hi = addr;
+
+    std::map<unsigned short, Block>::iterator it = blocks.upper_bound(addr);
+    if (it != blocks.begin()) --it;
+    while (it != blocks.end() && it->first < last)
+    {
+        if (it->second.end <= addr)
+        {
+            ++it;
+            continue;
+        }
+
+        lo = (it->second.start < lo) ? it->second.start : lo;
+        hi = (it->second.end > hi) ? it->second.end : hi;
+        for (unsigned int a = it->second.start; a < it->second.end; ++a) codeMap[a] = false;
+
+        worklist.push_back(it->first);
+        blocks.erase(it++);
+    }
+
+    explore(worklist);
+
+    // blocks overlapping the cleared span (misaligned code) get their bytes back
+    it = blocks.upper_bound(lo);
+    if (it != blocks.begin()) --it;
+    for (; it != blocks.end() && it->first < hi; ++it)
+    {
+        markCode(it->second);
+    }
+
+    ++version;
+}
+
+const Chip8Disassembler::Block *Chip8Disassembler::blockAt(unsigned short addr) const
+{
+    std::map<unsigned short, Block>::const_iterator it = blocks.upper_bound(addr);
+    if (it == blocks.begin()) return nullptr;
+    --it;
+    return (addr < it->second.end) ? &it->second : nullptr;
+}
+
+void Chip8Disassembler::buildListing(std::vector<Line> &lines) const
+{
+    // room for a line per word of the ROM area, the frame slots never grow later
+    lines.clear();
+    lines.reserve((4096 - 0x200) / 2);
+
+    unsigned int addr = 0x200;
+    std::map<unsigned short, Block>::const_iterator it = blocks.lower_bound(0x200);
+    while (addr < romEnd)
+    {
+        // skip blocks that start inside code we already listed
+        while (it != blocks.end() && it->first < addr) ++it;
+
+        const unsigned int dataEnd = (it != blocks.end() && it->first < romEnd) ? it->first : romEnd;
+        for (; addr < dataEnd; addr += 2)
+        {
+            Line line = {static_cast<unsigned short>(addr), static_cast<unsigned char>((addr + 1 < dataEnd) ? 2 : 1), false};
+            lines.push_back(line);
+        }
+        addr = dataEnd;
+
+        if (it == blocks.end() || addr >= romEnd) break;
+
+        for (unsigned int step; addr < it->second.end && addr < romEnd; addr += step)
+        {
+            step = instructionSize(addr);
+            Line line = {static_cast<unsigned short>(addr), static_cast<unsigned char>(step), true};
+            lines.push_back(line);
+        }
+        ++it;
+    }
+}
+
+void Chip8Disassembler::formatLine(const Line &line, char *buffer, size_t size) const
+{
+    formatLine(memory, line, buffer, size);
+}
+
+void Chip8Disassembler::formatLine(const unsigned char *memory, const Line &line, char *buffer, size_t size)
+{
+    const unsigned char hi = memory[line.addr];
+    const unsigned char lo = (line.size > 1) ? memory[line.addr + 1] : 0;
+
+    if (!line.code)
+    {
+        if (line.size > 1)
+            snprintf(buffer, size, "%04X: DB %02X %02X", line.addr, hi, lo);
+        else
+            snprintf(buffer, size, "%04X: DB %02X", line.addr, hi);
+        return;
+    }
+
+    char mnemonic[24];
+    if (line.size == 4) // XO-CHIP F000 NNNN
+        snprintf(mnemonic, sizeof(mnemonic), "LD I, %04X", memory[line.addr + 2] << 8 | memory[line.addr + 3]);
+    else
+        disassemble(hi << 8 | lo, mnemonic, sizeof(mnemonic));
+    snprintf(buffer, size, "%04X: %s", line.addr, mnemonic);
+}
+
+void Chip8Disassembler::disassemble(unsigned short opcode, char *buffer, size_t size)
+{
+    const unsigned int x = (opcode & 0x0F00) >> 8;
+    const unsigned int y = (opcode & 0x00F0) >> 4;
+    const unsigned int n = opcode & 0x000F;
+    const unsigned int nn = opcode & 0x00FF;
+    const unsigned int nnn = opcode & 0x0FFF;
+
+    static const char *const alu[16] = {
+        "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+
+    switch (opcode & 0xF000)
+    {
+    case 0x0000:
+        if (opcode == 0x00E0) snprintf(buffer, size, "CLS");
+        else if (opcode == 0x00EE) snprintf(buffer, size, "RET");
+        else snprintf(buffer, size, "SYS %03X", nnn);
+        return;
+    case 0x1000: snprintf(buffer, size, "JP %03X", nnn); return;
+    case 0x2000: snprintf(buffer, size, "CALL %03X", nnn); return;
+    case 0x3000: snprintf(buffer, size, "SE V%X, %02X", x, nn); return;
+    case 0x4000: snprintf(buffer, size, "SNE V%X, %02X", x, nn); return;
+    case 0x5000:
+        if (n == 0x2) { snprintf(buffer, size, "SAVE V%X-V%X", x, y); return; } // XO-CHIP
+        if (n == 0x3) { snprintf(buffer, size, "LOAD V%X-V%X", x, y); return; }
+        snprintf(buffer, size, "SE V%X, V%X", x, y);
+        return;
+    case 0x6000: snprintf(buffer, size, "LD V%X, %02X", x, nn); return;
+    case 0x7000: snprintf(buffer, size, "ADD V%X, %02X", x, nn); return;
+    case 0x8000:
+        if (alu[n])
+        {
+            snprintf(buffer, size, "%s V%X, V%X", alu[n], x, y);
+            return;
+        }
+        break;
+    case 0x9000: snprintf(buffer, size, "SNE V%X, V%X", x, y); return;
+    case 0xA000: snprintf(buffer, size, "LD I, %03X", nnn); return;
+    case 0xB000: snprintf(buffer, size, "JP V0, %03X", nnn); return;
+    case 0xC000: snprintf(buffer, size, "RND V%X, %02X", x, nn); return;
+    case 0xD000: snprintf(buffer, size, "DRW V%X, V%X, %X", x, y, n); return;
+    case 0xE000:
+        if (nn == 0x9E) { snprintf(buffer, size, "SKP V%X", x); return; }
+        if (nn == 0xA1) { snprintf(buffer, size, "SKNP V%X", x); return; }
+        break;
+    case 0xF000:
+        // XO-CHIP
+        if (opcode == 0xF000) { snprintf(buffer, size, "LD I, long"); return; }
+        if (opcode == 0xF002) { snprintf(buffer, size, "AUDIO"); return; }
+        if (nn == 0x01) { snprintf(buffer, size, "PLANE %X", x); return; }
+        switch (nn)
+        {
+        case 0x3A: snprintf(buffer, size, "PITCH V%X", x); return;
+        case 0x07: snprintf(buffer, size, "LD V%X, DT", x); return;
+        case 0x0A: snprintf(buffer, size, "LD V%X, K", x); return;
+        case 0x15: snprintf(buffer, size, "LD DT, V%X", x); return;
+        case 0x18: snprintf(buffer, size, "LD ST, V%X", x); return;
+        case 0x1E: snprintf(buffer, size, "ADD I, V%X", x); return;
+        case 0x29: snprintf(buffer, size, "LD F, V%X", x); return;
+        case 0x33: snprintf(buffer, size, "LD B, V%X", x); return;
+        case 0x55: snprintf(buffer, size, "LD [I], V%X", x); return;
+        case 0x65: snprintf(buffer, size, "LD V%X, [I]", x); return;
+        }
+        break;
+    }
+
+    snprintf(buffer, size, "DW %04X", opcode);
+}
+
+void Chip8Disassembler::explore(std::vector<unsigned short> &worklist)
+{
+    while (!worklist.empty())
+    {
+        const unsigned short start = worklist.back();
+        worklist.pop_back();
+
+        if (start + 1 >= 4096 || blocks.count(start)) continue;
+
+        // landing in the middle of a known block splits it in two
+        std::map<unsigned short, Block>::iterator it = blocks.upper_bound(start);
+        if (it != blocks.begin())
+        {
+            --it;
+            Block &outer = it->second;
+            if (start < outer.end && ((start - outer.start) & 1) == 0)
+            {
+                splitBlock(outer, start);
+                continue;
+            }
+        }
+
+        Block block;
+        block.start = start;
+
+        unsigned short pc = start;
+        bool ends = false;
+        while (!ends)
+        {
+            // fell through into the next block
+            if (pc != start && blocks.count(pc))
+            {
+                block.successors.push_back(pc);
+                break;
+            }
+            if (pc + 1 >= 4096) break;
+
+            const unsigned short opcode = memory[pc] << 8 | memory[pc + 1];
+            const unsigned short nnn = opcode & 0x0FFF;
+            pc += 2;
+            ends = true;
+
+            switch (opcode & 0xF000)
+            {
+            case 0x0000:
+                if (opcode == 0x00E0) ends = false;
+                else if (opcode == 0x00EE) block.returns = true;
+                // any other 0NNN stalls the interpreter, nothing follows it
+                break;
+            case 0x1000: // jump
+                block.successors.push_back(nnn);
+                break;
+            case 0x2000: // call, execution resumes after it on return
+                block.successors.push_back(nnn);
+                block.successors.push_back(pc);
+                break;
+            case 0x5000:
+                if (xoChip && (opcode & 0x000E) == 0x0002) // register range save/load
+                {
+                    ends = false;
+                    break;
+                }
+                // fall through
+            case 0x3000: // skips branch to the next or the one after
+            case 0x4000:
+            case 0x9000:
+                block.successors.push_back(pc);
+                block.successors.push_back(pc + instructionSize(pc));
+                break;
+            case 0xB000: // jump through V0, only known at runtime
+                block.indirect = true;
+                break;
+            case 0xE000:
+                if ((opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1)
+                {
+                    block.successors.push_back(pc);
+                    block.successors.push_back(pc + instructionSize(pc));
+                }
+                else
+                {
+                    ends = false;
+                }
+                break;
+            case 0xF000:
+                if (xoChip && opcode == 0xF000) pc += 2; // the address word
+                ends = false;
+                break;
+            default:
+                ends = false;
+                break;
+            }
+        }
+
+        block.end = pc;
+        worklist.insert(worklist.end(), block.successors.begin(), block.successors.end());
+        markCode(block);
+        blocks[start] = block;
+    }
+}
+
+void Chip8Disassembler::splitBlock(Block &block, unsigned short addr)
+{
+    Block tail;
+    tail.start = addr;
+    tail.end = block.end;
+    tail.successors.swap(block.successors);
+    tail.indirect = block.indirect;
+    tail.returns = block.returns;
+
+    block.end = addr;
+    block.successors.assign(1, addr);
+    block.indirect = false;
+    block.returns = false;
+
+    blocks[addr] = tail;
+}
+
+// 4 for XO-CHIP's F000 NNNN, 2 for everything else
+unsigned int Chip8Disassembler::instructionSize(unsigned int addr) const
+{
+    if (xoChip && addr + 3 < 4096 && memory[addr] == 0xF0 && memory[addr + 1] == 0x00) return 4;
+    return 2;
+}
+
+void Chip8Disassembler::markCode(const Block &block)
+{
+    for (unsigned int a = block.start; a < block.end && a < 4096; ++a)
+    {
+        codeMap[a] = true;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef CHIP8DISASM_H
+#define CHIP8DISASM_H
+
+#include <map>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Recursive descent disassembler.
+ *
+ * Follows jumps, calls and skips from the entry point to split the ROM into
+ * code and data, and groups the code into basic blocks with their successor
+ * edges. The analysis runs once at load and is patched in place when the
+ * program writes into its own code (FX33/FX55).
+ *
+ * With XO-CHIP on, F000 NNNN is one 4 byte instruction and skips step over
+ * it whole. Only the first 4K is analyzed either way.
+ */
+class Chip8Disassembler
+{
+public:
+    struct Block
+    {
+        unsigned short start;                  // address of the first instruction
+        unsigned short end;                    // one past the last instruction
+        std::vector<unsigned short> successors;
+        bool indirect = false;                 // ends in BNNN, targets unknown
+        bool returns = false;                  // ends in 00EE
+    };
+
+    // One row of the listing, either an instruction or data bytes
+    struct Line
+    {
+        unsigned short addr;
+        unsigned char size;
+        bool code;
+    };
+
+    // Analyze the program in memory, starting from entry
+    void analyze(const unsigned char *memory, long romSize, unsigned short entry = 0x200);
+
+    // Before analyze, decodes the XO-CHIP instructions that change the flow
+    void setXOChip(bool on) { xoChip = on; }
+
+    // Tell the analysis that the program wrote len bytes at addr
+    void memoryWritten(unsigned short addr, unsigned short len);
+
+    bool isCode(unsigned short addr) const { return addr < 4096 && codeMap[addr]; }
+    bool isBlockStart(unsigned short addr) const { return blocks.count(addr) != 0; }
+
+    // Block containing addr, or nullptr if addr is not code
+    const Block *blockAt(unsigned short addr) const;
+    const std::map<unsigned short, Block> &getBlocks() const { return blocks; }
+
+    // Listing of the ROM area, code and data interleaved by address
+    void buildListing(std::vector<Line> &lines) const;
+    void formatLine(const Line &line, char *buffer, size_t size) const;
+    // Same against a copy of memory, e.g. a frame on the render thread
+    static void formatLine(const unsigned char *memory, const Line &line, char *buffer, size_t size);
+
+    // Bumped whenever the listing would change
+    unsigned long getVersion() const { return version; }
+
+    // Mnemonic for a single opcode, e.g. "LD V3, 0F"
+    static void disassemble(unsigned short opcode, char *buffer, size_t size);
+
+private:
+    const unsigned char *memory = nullptr;
+    unsigned short romStart = 0x200;
+    unsigned short romEnd = 0x200;
+    bool xoChip = false;
+
+    std::map<unsigned short, Block> blocks; // keyed by start address
+    bool codeMap[4096] = {false};
+
+    unsigned long version = 0;
+
+    // walk new blocks from the addresses in the worklist
+    void explore(std::vector<unsigned short> &worklist);
+    void splitBlock(Block &block, unsigned short addr);
+    void markCode(const Block &block);
+    unsigned int instructionSize(unsigned int addr) const;
+};
+
+#endif // CHIP8DISASM_H
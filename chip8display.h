@@ -0,0 +1,32 @@
+#ifndef CHIP8DISPLAY_H
+#define CHIP8DISPLAY_H
+
+#include "chip8frame.h"
+#include "chip8latency.h"
+
+/*
+ * What the render thread drives: shows the frames the core published and
+ * turns the user's input into Chip8Input for the core. Chip8GFX is the SDL
+ * window, Chip8Terminal draws into the terminal it was started from.
+ */
+class Chip8Display
+{
+public:
+    virtual ~Chip8Display() {}
+
+    virtual void drawGraphics(const Chip8Frame &frame) = 0;
+
+    // Something besides a new frame wants the last one drawn again
+    virtual bool needsRedraw() const = 0;
+
+    // Keys and commands go to the core through link, quitting clears link.running
+    virtual void handleEvents(Chip8Link &link) = 0;
+
+    // Once at shutdown, the render thread is done with the display
+    virtual void cleanUp() = 0;
+
+    // Key press to present times
+    virtual const Chip8LatencyStats &getLatency() const = 0;
+};
+
+#endif // CHIP8DISPLAY_H
@@ -0,0 +1,77 @@
+#ifndef CHIP8FRAME_H
+#define CHIP8FRAME_H
+
+#include <atomic>
+#include <vector>
+#include "chip8.h"
+#include "chip8disasm.h"
+#include "chip8ring.h"
+#include "chip8triple.h"
+
+/*
+ * What the emulation thread and the render thread exchange.
+ *
+ * The core owns the Chip8 and only ever hands out copies: a Chip8Frame is
+ * everything the game window and the debugger show, published through a
+ * triple buffer. Keys and debugger commands travel the other way through
+ * an SPSC ring, in the order they happened.
+ */
+
+// Snapshot taken when the core presents
+struct Chip8Frame
+{
+    Chip8Frame() : state(), breakpoints(), heatReads(), heatWrites() {}
+
+    Chip8State state;
+    unsigned int clockRate = Chip8::DEFAULT_CLOCK_RATE; // cycles per emulated second, state.cycles over this is time
+    bool xoChip = false;             // pixels are plane bits, four colors
+    bool paused = false;
+    char breakReason[48] = "";
+    unsigned char breakpoints[4096]; // nonzero where a breakpoint is set
+    unsigned long breakpointsVersion = ~0ul;
+    Chip8KeyTrace keyTrace;          // latest traced key press, counted once drawn and presented
+
+    // per byte access totals while the heat map is on, the debugger diffs consecutive frames
+    bool heatOn = false;
+    unsigned int heatReads[4096];
+    unsigned int heatWrites[4096];
+
+    // with --run-ahead the state is this many frames in the future, the
+    // core's time spent running ahead and restoring is averaged per frame
+    int runAhead = 0;
+    long long runAheadNs = 0;
+
+    // disassembly, rebuilt in a slot only when the analysis changed
+    std::vector<Chip8Disassembler::Line> listing;
+    unsigned long listingVersion = ~0ul;
+};
+
+// Renderer -> core
+struct Chip8Input
+{
+    enum Type : unsigned char
+    {
+        KEY,        // key pressed or released
+        RESTART,    // ESC
+        RUN_PAUSE,  // F5
+        BREAKPOINT, // F9, toggle on the current PC
+        STEP_OVER,  // F10
+        STEP,       // F11
+        HEAT_MAP,   // F7, toggle counting for the heat map
+        REWIND      // Backspace held (pressed) and let go
+    };
+
+    Type type;
+    unsigned char key;
+    bool pressed;
+    long long time; // chip8Now() when SDL queued a KEY event
+};
+
+struct Chip8Link
+{
+    Chip8TripleBuffer<Chip8Frame> frames; // core -> renderer
+    Chip8Ring<Chip8Input, 256> input;     // renderer -> core
+    std::atomic<bool> running{true};      // cleared by whichever side quits
+};
+
+#endif // CHIP8FRAME_H
@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "chip8.h"
+#include "chip8disasm.h"
+#include "logger.h"
+
+/*
+ * Coverage guided fuzz target for the core, built by `make fuzz` (libFuzzer).
+ *
+ * Input: u16 little endian ROM length, the ROM, then an input script of
+ * 2 byte steps: cycles to run (0-255), then a keypad event (bit 4 set for
+ * pressed, low 4 bits the key). After the script the ROM runs TAIL_CYCLES
+ * more. The core runs headless with the disassembler attached.
+ *
+ * Every input starts from a snapshot of a freshly initialized machine
+ * instead of a new Chip8, so a run costs one state copy plus the ROM.
+ *
+ * Build with -DCHIP8_FUZZ_STANDALONE (no libFuzzer, e.g. gcc with
+ * -fsanitize=address,undefined) to replay inputs from files.
+ */
+
+namespace
+{
+
+const long TAIL_CYCLES = 2000;
+const long MAX_CYCLES = 100000; // per input, keeps execs fast
+
+Chip8 *chip8 = nullptr;
+Chip8Disassembler disasm;
+Chip8State boot;
+
+void setup()
+{
+    // unknown opcodes warn to stderr and the log, every other input has some
+    Logger::setLevel(CHIP8_LOG_OFF);
+
+    chip8 = new Chip8();
+    chip8->setDisassembler(&disasm);
+    chip8->initialize();
+    chip8->saveState(boot);
+}
+
+void run(long n, long &cycles)
+{
+    n = std::min(n, MAX_CYCLES - cycles);
+    if (n <= 0) return;
+    chip8->runCycles(static_cast<int>(n));
+    cycles += n;
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (chip8 == nullptr) setup();
+    if (size < 2) return 0;
+
+    size_t romSize = data[0] | data[1] << 8;
+    data += 2;
+    size -= 2;
+    romSize = std::min(romSize, std::min(size, static_cast<size_t>(4096 - 0x200)));
+
+    // snapshot reset, then the ROM on top of it
+    chip8->loadState(boot);
+    chip8->seedRandom(1);
+    chip8->loadROM(data, static_cast<long>(romSize));
+    disasm.analyze(chip8->getMemory(), static_cast<long>(romSize));
+
+    const uint8_t *script = data + romSize;
+    const size_t steps = (size - romSize) / 2;
+    long cycles = 0;
+    for (size_t s = 0; s < steps && cycles < MAX_CYCLES; ++s)
+    {
+        run(script[s * 2], cycles);
+        chip8->setKey(script[s * 2 + 1] & 0xF, (script[s * 2 + 1] >> 4) & 1);
+    }
+    run(TAIL_CYCLES, cycles);
+    return 0;
+}
+
+#ifdef CHIP8_FUZZ_STANDALONE
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: ./chip8fuzz <input>...\n");
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == nullptr)
+        {
+            std::perror(argv[i]);
+            return 1;
+        }
+        std::vector<uint8_t> input;
+        int c;
+        while ((c = fgetc(file)) != EOF) input.push_back(static_cast<uint8_t>(c));
+        fclose(file);
+
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        std::fprintf(stderr, "%s: ok\n", argv[i]);
+    }
+    return 0;
+}
+#endif
@@ -1,60 +1,94 @@
 #include "chip8gfx.h"
-#include "chip8.h"
+#include "chip8trace.h"
+#include "chip8alloc.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_map>
+#include <cmath>
 
-Chip8GFX::Chip8GFX(Chip8* chip8Ptr) : chip8(chip8Ptr) {
+namespace
+{
 
-    // Initialize display buffer
-    display = chip8->getDisplayBuffer();
-    if (display == nullptr) {
-        std::cerr << "Error: Display buffer is null!" << std::endl;
-        exit(1);
+struct Palette
+{
+    const char *name;
+    Uint32 on;
+    Uint32 off;
+    Uint32 plane2; // XO-CHIP
+    Uint32 both;
+};
+
+const Palette PALETTES[] = {
+    {"mono",  0xFFFFFFFF, 0x000000FF, 0x555555FF, 0xAAAAAAFF},
+    {"amber", 0xFFB000FF, 0x1A0F00FF, 0x8C4A00FF, 0xFFE08CFF},
+    {"green", 0x33FF66FF, 0x001A08FF, 0x0F7A30FF, 0xB3FFC6FF},
+    {"lcd",   0x0F380FFF, 0x9BBC0FFF, 0x8BAC0FFF, 0x306230FF},
+    {"blue",  0x8BE9FDFF, 0x0B1B33FF, 0x3A6EA5FF, 0xE0F8FFFF},
+};
+
+// a + (b - a) * weight / 4 per channel, alpha from a
+Uint32 blend(Uint32 a, Uint32 b, int weight)
+{
+    Uint32 out = a & 0xFF;
+    for (int shift = 8; shift < 32; shift += 8)
+    {
+        const int ca = a >> shift & 0xFF, cb = b >> shift & 0xFF;
+        out |= static_cast<Uint32>(ca + (cb - ca) * weight / 4) << shift;
     }
-    
-    // clear display
-    memset(display, 0, 64 * 32 * sizeof(unsigned char));
+    return out;
+}
 
-    // --- DEBUG WINDOW SETUP ---
+// RRGGBB, returns the next character or nullptr
+const char *parseColor(const char *spec, Uint32 &color)
+{
+    char *end;
+    const unsigned long rgb = strtoul(spec, &end, 16);
+    if (end != spec + 6) return nullptr;
+    color = static_cast<Uint32>(rgb << 8 | 0xFF);
+    return end;
+}
 
-    // Initialize SDL first
-    if (SDL_Init(SDL_INIT_VIDEO) != 0)
-    {
-        std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
-        exit(1);
-    }
+// 8 pixel bytes (0 or 1) to one byte, leftmost pixel in the MSB
+inline unsigned int packPixels(const unsigned char *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // every pixel bit lands on its own bit of the top byte
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return static_cast<unsigned int>(((v & 0x0101010101010101ull) * 0x8040201008040201ull) >> 56);
+#else
+    unsigned int bits = 0;
+    for (int i = 0; i < 8; ++i) bits = bits << 1 | (p[i] & 1);
+    return bits;
+#endif
+}
 
-    // Then initialize TTF
-    if (TTF_Init() != 0)
-    {
-        std::cerr << "TTF_Init Error: " << TTF_GetError() << std::endl;
-        SDL_Quit();
-        exit(1);
-    }
+} // namespace
 
-    // Load a font
-    font = TTF_OpenFont("KodeMono-VariableFont_wght.ttf", 16); // Adjust path and size as needed
-    if (font == nullptr)
+Chip8GFX::Chip8GFX() {
+
+    // Initialize SDL first, TTF and the debug window wait until the debugger is opened
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
-        std::cerr << "TTF_OpenFont Error: " << TTF_GetError() << std::endl;
-        TTF_Quit();
-        SDL_Quit();
+        std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
         exit(1);
     }
 
-    // Now create both windows after SDL is initialized
-    initializeDebugWindow();
-
     // Create main window for graphics
-    window = SDL_CreateWindow("CHIP-8 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 320, SDL_WINDOW_SHOWN);
+    window = SDL_CreateWindow("CHIP-8 Emulator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 320,
+                              SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
     if (window == nullptr)
     {
         std::cerr << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
         SDL_Quit();
         exit(1);
     }
+    SDL_SetWindowMinimumSize(window, 64, 32);
 
-    // Create a renderer
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Create a renderer, waiting for vsync here only holds up the render thread
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (renderer == nullptr)
     {
         std::cerr << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
@@ -63,7 +97,9 @@ Chip8GFX::Chip8GFX(Chip8* chip8Ptr) : chip8(chip8Ptr) {
         exit(1);
     }
 
-    // Create a texture for graphics on the game window
+    // Create a texture for graphics on the game window, the GPU does the
+    // scaling so the CPU cost doesn't depend on the window size
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0"); // nearest
     gfxTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
     if (gfxTexture == nullptr)
     {
@@ -74,17 +110,36 @@ Chip8GFX::Chip8GFX(Chip8* chip8Ptr) : chip8(chip8Ptr) {
         exit(1);
     }
 
+    setPalette(PALETTES[0].on, PALETTES[0].off, PALETTES[0].plane2, PALETTES[0].both);
 }
 
-void Chip8GFX::initializeDebugWindow()
+bool Chip8GFX::initializeDebugWindow()
 {
+    // The debugger is optional, failures here leave the emulator running without it
+    if (TTF_Init() != 0)
+    {
+        std::cerr << "TTF_Init Error: " << TTF_GetError() << std::endl;
+        return false;
+    }
+
+    // Load a font
+    font = TTF_OpenFont("KodeMono-VariableFont_wght.ttf", 16); // Adjust path and size as needed
+    if (font == nullptr)
+    {
+        std::cerr << "TTF_OpenFont Error: " << TTF_GetError() << std::endl;
+        TTF_Quit();
+        return false;
+    }
+
     // Create a window for debugging
-    debugWindow = SDL_CreateWindow("CHIP-8 Debugger", SDL_WINDOWPOS_CENTERED + 320, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_SHOWN);
+    debugWindow = SDL_CreateWindow("CHIP-8 Debugger", SDL_WINDOWPOS_CENTERED + 320, SDL_WINDOWPOS_CENTERED, 800, 720, SDL_WINDOW_SHOWN);
     if (debugWindow == nullptr)
     {
         std::cerr << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
-        SDL_Quit();
-        exit(1);
+        TTF_CloseFont(font);
+        TTF_Quit();
+        font = nullptr;
+        return false;
     }
 
     // Create a renderer for the debug window
@@ -93,62 +148,331 @@ void Chip8GFX::initializeDebugWindow()
     {
         std::cerr << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
         SDL_DestroyWindow(debugWindow);
-        SDL_Quit();
-        exit(1);
+        TTF_CloseFont(font);
+        TTF_Quit();
+        debugWindow = nullptr;
+        font = nullptr;
+        return false;
+    }
+
+    // Glyph cache, white so renderText can tint it, a space has a size but no texture
+    const SDL_Color white = {255, 255, 255, 255};
+    for (int g = 0; g < GLYPHS; ++g)
+    {
+        const char text[2] = {static_cast<char>(FIRST_GLYPH + g), '\0'};
+        glyphSize[g] = SDL_Rect{0, 0, 0, 0};
+        TTF_SizeText(font, text, &glyphSize[g].w, &glyphSize[g].h);
+        SDL_Surface *surface = TTF_RenderText_Solid(font, text, white);
+        if (surface == nullptr) continue;
+        glyphs[g] = SDL_CreateTextureFromSurface(debugRenderer, surface);
+        glyphSize[g].w = surface->w;
+        glyphSize[g].h = surface->h;
+        SDL_FreeSurface(surface);
     }
+    return true;
 }
 
-void Chip8GFX::drawGraphics()
+void Chip8GFX::toggleDebugWindow()
 {
-    // Prepare a pixel buffer (RGBA)
-    uint32_t pixels[64 * 32];
-    for (int i = 0; i < 64 * 32; ++i) {
-        pixels[i] = display[i] ? 0xFFFFFFFF : 0x000000FF; // White or Black (RGBA)
+    if (debugWindow == nullptr)
+    {
+        Chip8AllocCheck::Allow allow; // fonts, windows and the glyph cache
+        debugVisible = initializeDebugWindow();
+    }
+    else if (debugVisible)
+    {
+        SDL_HideWindow(debugWindow);
+        debugVisible = false;
     }
+    else
+    {
+        SDL_ShowWindow(debugWindow);
+        debugVisible = true;
+    }
+    redraw = true;
+}
+
+void Chip8GFX::drawGraphics(const Chip8Frame &frame)
+{
+    Chip8TraceSpan span("drawGraphics");
+    redraw = false;
 
-    // Update the texture with the pixel buffer
-    SDL_UpdateTexture(gfxTexture, nullptr, pixels, 64 * sizeof(uint32_t));
+    // Expand straight into the texture, one table lookup per 8 pixels
+    void *texels;
+    int pitch;
+    if (SDL_LockTexture(gfxTexture, nullptr, &texels, &pitch) == 0)
+    {
+        for (int y = 0; y < 32; ++y)
+        {
+            Uint32 *row = reinterpret_cast<Uint32 *>(static_cast<unsigned char *>(texels) + y * pitch);
+            const unsigned char *src = frame.state.gfx + y * 64;
+            if (frame.xoChip)
+            {
+                // two planes, a color per pixel value
+                for (int x = 0; x < 64; ++x) row[x] = colors[src[x] & 3];
+                continue;
+            }
+            for (int x = 0; x < 64; x += 8)
+            {
+                memcpy(row + x, expandLUT[packPixels(src + x)], sizeof(expandLUT[0]));
+            }
+        }
+        SDL_UnlockTexture(gfxTexture);
+    }
 
-    // Clear the renderer
+    // Clear the renderer, this is the letterbox color
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
-    // Set destination rect for scaling
-    SDL_Rect destRect = {0, 0, 640, 320}; // Scale 64x32 to 640x320
+    // Largest whole number scale that fits, centered
+    int outW = 640, outH = 320;
+    SDL_GetRendererOutputSize(renderer, &outW, &outH);
+    const int scale = std::max(1, std::min(outW / 64, outH / 32));
+    SDL_Rect destRect = {(outW - 64 * scale) / 2, (outH - 32 * scale) / 2, 64 * scale, 32 * scale};
 
     // Copy the texture to the renderer
     SDL_RenderCopy(renderer, gfxTexture, nullptr, &destRect);
 
-    // Present the renderer
-    SDL_RenderPresent(renderer);
+    // Present the renderer, blocks in vsync
+    {
+        Chip8TraceSpan present("SDL_RenderPresent");
+        SDL_RenderPresent(renderer);
+    }
+
+    // a traced key press reached the screen, once per press
+    if (frame.keyTrace.drawn != 0 && frame.keyTrace.id != lastTraceId)
+    {
+        latency.record(frame.keyTrace, chip8Now());
+        lastTraceId = frame.keyTrace.id;
+    }
 
     // update debug window
-    renderDebugInfo();
+    renderDebugInfo(frame);
+}
+
+void Chip8GFX::setPalette(Uint32 on, Uint32 off, Uint32 plane2, Uint32 both)
+{
+    for (int bits = 0; bits < 256; ++bits)
+    {
+        for (int p = 0; p < 8; ++p)
+        {
+            expandLUT[bits][p] = (bits & (0x80 >> p)) ? on : off;
+        }
+    }
+    colors[0] = off;
+    colors[1] = on;
+    colors[2] = plane2;
+    colors[3] = both;
+    redraw = true;
+}
+
+bool Chip8GFX::setPalette(const char *spec)
+{
+    for (const Palette &palette : PALETTES)
+    {
+        if (strcmp(spec, palette.name) == 0)
+        {
+            setPalette(palette.on, palette.off, palette.plane2, palette.both);
+            return true;
+        }
+    }
+
+    // RRGGBB,RRGGBB or RRGGBB,RRGGBB,RRGGBB,RRGGBB
+    Uint32 color[4];
+    int count = 0;
+    const char *p = spec;
+    for (;;)
+    {
+        p = parseColor(p, color[count++]);
+        if (p == nullptr || *p != ',' || count == 4) break;
+        ++p;
+    }
+    if (p == nullptr || *p != '\0' || (count != 2 && count != 4)) return false;
+    if (count == 2)
+    {
+        // off to on, plane 2 halfway and both planes most of the way
+        color[2] = blend(color[1], color[0], 2);
+        color[3] = blend(color[1], color[0], 3);
+    }
+
+    setPalette(color[0], color[1], color[2], color[3]);
+    return true;
+}
+
+const char *Chip8GFX::paletteNames()
+{
+    static std::string names;
+    if (names.empty())
+    {
+        for (const Palette &palette : PALETTES)
+        {
+            if (!names.empty()) names += ", ";
+            names += palette.name;
+        }
+    }
+    return names.c_str();
+}
+
+void Chip8GFX::toggleFullscreen()
+{
+    Chip8AllocCheck::Allow allow; // a mode switch rebuilds the swap chain
+    const bool fullscreen = (SDL_GetWindowFlags(window) & SDL_WINDOW_FULLSCREEN) != 0;
+    SDL_SetWindowFullscreen(window, fullscreen ? 0 : SDL_WINDOW_FULLSCREEN_DESKTOP);
+    redraw = true;
+}
+
+void Chip8GFX::handleEvents(Chip8Link &link)
+{
+    static const std::unordered_map<SDL_Keycode, uint8_t> keymap = {
+        { SDLK_1, 0x1 }, { SDLK_2, 0x2 }, { SDLK_3, 0x3 }, { SDLK_4, 0xC },
+        { SDLK_q, 0x4 }, { SDLK_w, 0x5 }, { SDLK_e, 0x6 }, { SDLK_r, 0xD },
+        { SDLK_a, 0x7 }, { SDLK_s, 0x8 }, { SDLK_d, 0x9 }, { SDLK_f, 0xE },
+        { SDLK_z, 0xA }, { SDLK_x, 0x0 }, { SDLK_c, 0xB }, { SDLK_v, 0xF },
+    };
+
+    Chip8TraceSpan span("handleEvents");
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+            case SDL_QUIT:
+                link.running = false;
+                break;
+
+            case SDL_WINDOWEVENT:
+                // resized or uncovered, present again at the new scale
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED || event.window.event == SDL_WINDOWEVENT_EXPOSED)
+                    redraw = true;
+                // closing the debugger only hides it, closing the game window quits
+                if (event.window.event == SDL_WINDOWEVENT_CLOSE)
+                {
+                    if (event.window.windowID == getDebugWindowID())
+                        toggleDebugWindow();
+                    else
+                        link.running = false;
+                }
+                break;
+
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+            {
+                const bool pressed = (event.type == SDL_KEYDOWN);
+                // SDL stamps in ms, counts the time it sat in the queue while we were presenting
+                const long long queued = static_cast<long long>(SDL_GetTicks() - event.key.timestamp) * 1000000;
+                Chip8Input input = {Chip8Input::KEY, 0, pressed, chip8Now() - queued};
+
+                // global keys
+                if (event.key.keysym.sym == SDLK_ESCAPE)
+                {
+                    if (pressed)  // only on press, the core resets in place
+                    {
+                        input.type = Chip8Input::RESTART;
+                        link.input.push(input);
+                    }
+                    break;
+                }
+                if (event.key.keysym.sym == SDLK_BACKSPACE)
+                {
+                    if (!event.key.repeat)
+                    {
+                        input.type = Chip8Input::REWIND;
+                        link.input.push(input);
+                    }
+                    break;
+                }
+                if (event.key.keysym.sym == SDLK_F8)
+                {
+                    if (pressed)
+                        Chip8Trace::write(); // --trace, save what we have so far
+                    break;
+                }
+                if (event.key.keysym.sym == SDLK_F12)
+                {
+                    if (pressed)
+                        toggleDebugWindow();
+                    break;
+                }
+                if (event.key.keysym.sym == SDLK_RETURN && (event.key.keysym.mod & KMOD_ALT))
+                {
+                    if (pressed)
+                        toggleFullscreen();
+                    break;
+                }
+
+                // debugger keys, only while the debug window has focus
+                if (pressed && event.key.windowID == getDebugWindowID())
+                {
+                    bool handled = true;
+                    switch (event.key.keysym.sym)
+                    {
+                        case SDLK_F5:  input.type = Chip8Input::RUN_PAUSE; break;
+                        case SDLK_F7:  input.type = Chip8Input::HEAT_MAP; break;
+                        case SDLK_F9:  input.type = Chip8Input::BREAKPOINT; break;
+                        case SDLK_F10: input.type = Chip8Input::STEP_OVER; break;
+                        case SDLK_F11: input.type = Chip8Input::STEP; break;
+                        default:
+                            handled = false;
+                            break;
+                    }
+                    if (handled)
+                    {
+                        link.input.push(input);
+                        break;
+                    }
+                }
+
+                // chip8 keys, as events so a tap shorter than a core pass still arrives
+                auto it = keymap.find(event.key.keysym.sym);
+                if (it != keymap.end() && !event.key.repeat)
+                {
+                    input.key = it->second;
+                    link.input.push(input);
+                }
+
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
 }
 
 void Chip8GFX::cleanUp()
 {
-    // Cleanup and exit
+    // Cleanup and exit, only once at shutdown
     SDL_DestroyTexture(gfxTexture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
-    SDL_DestroyRenderer(debugRenderer);
-    SDL_DestroyWindow(debugWindow);
-    TTF_CloseFont(font);
-    TTF_Quit();
+    if (debugWindow)
+    {
+        for (SDL_Texture *glyph : glyphs)
+        {
+            if (glyph) SDL_DestroyTexture(glyph);
+        }
+        if (heatTexture) SDL_DestroyTexture(heatTexture);
+        SDL_DestroyRenderer(debugRenderer);
+        SDL_DestroyWindow(debugWindow);
+        TTF_CloseFont(font);
+        TTF_Quit();
+        debugWindow = nullptr;
+    }
     SDL_Quit();
 }
 
 
-void Chip8GFX::renderDebugInfo() {
-    // Access values via chip8 pointer, e.g. chip8->V, chip8->I, etc.
-    uint8_t* V = chip8->getV();
-    uint16_t I = chip8->getI();
-    uint16_t pc = chip8->getPC();
-    uint8_t sp = chip8->getSP();
-    uint8_t delay_timer = chip8->getDelayTimer();
-    uint8_t sound_timer = chip8->getSoundTimer();
-    uint8_t memory[4096];
-    memcpy(memory, chip8->getMemory(), 4096);
+void Chip8GFX::renderDebugInfo(const Chip8Frame &frame) {
+    if (!debugVisible) return;
+    Chip8TraceSpan span("renderDebugInfo");
+
+    // Values from the published frame, the core keeps running meanwhile
+    const uint8_t* V = frame.state.V;
+    uint16_t I = frame.state.I;
+    uint16_t pc = frame.state.pc;
+    uint8_t sp = frame.state.sp;
+    uint8_t delay_timer = frame.state.delay_timer;
+    uint8_t sound_timer = frame.state.sound_timer;
 
     // Clear the debug window
     SDL_SetRenderDrawColor(debugRenderer, 0, 0, 0, 255); // Black
@@ -156,155 +480,166 @@ void Chip8GFX::renderDebugInfo() {
 
     SDL_Color white = {255, 255, 255, 255}; // White color for normal text
 
-    // --- Register caching ---
+    // --- Registers ---
+    char buffer[32];
     for (int i = 0; i < 16; ++i)
     {
-        char buffer[16];
         snprintf(buffer, sizeof(buffer), "V[%X]: %02X", i, V[i]);
-        std::string text(buffer);
-        if (!registerTextures[i] || lastRegisterText[i] != text) {
-            if (registerTextures[i]) SDL_DestroyTexture(registerTextures[i]);
-            SDL_Surface *surface = TTF_RenderText_Solid(font, buffer, white);
-            registerTextures[i] = SDL_CreateTextureFromSurface(debugRenderer, surface);
-            SDL_FreeSurface(surface);
-            lastRegisterText[i] = text;
-        }
-        // Render cached texture
-        int text_width = 0, text_height = 0;
-        TTF_SizeText(font, buffer, &text_width, &text_height);
-        SDL_Rect destRect = {10, 20 * i, text_width, text_height};
-        SDL_RenderCopy(debugRenderer, registerTextures[i], nullptr, &destRect);
+        renderText(10, 20 * i, buffer, white);
     }
 
-    // --- Other registers (no caching for simplicity, but can be added similarly) ---
-    char buffer[32];
     snprintf(buffer, sizeof(buffer), "I: %04X", I);
-    renderText(debugRenderer, 10, 20 * 16, buffer, white);
+    renderText(10, 20 * 16, buffer, white);
 
     snprintf(buffer, sizeof(buffer), "PC: %04X", pc);
-    renderText(debugRenderer, 10, 20 * 17, buffer, white);
+    renderText(10, 20 * 17, buffer, white);
 
     snprintf(buffer, sizeof(buffer), "SP: %02X", sp);
-    renderText(debugRenderer, 10, 20 * 18, buffer, white);
+    renderText(10, 20 * 18, buffer, white);
 
     snprintf(buffer, sizeof(buffer), "Delay Timer: %02X", delay_timer);
-    renderText(debugRenderer, 10, 20 * 19, buffer, white);
+    renderText(10, 20 * 19, buffer, white);
 
     snprintf(buffer, sizeof(buffer), "Sound Timer: %02X", sound_timer);
-    renderText(debugRenderer, 10, 20 * 20, buffer, white);
-
-    // --- Memory instruction caching ---
-    int memCount = (chip8->getBufferSize() + 1) / 2;
-    if ((int)memTextures.size() != memCount) {
-        // Resize and clear if ROM size changes
-        for (auto tex : memTextures) if (tex) SDL_DestroyTexture(tex);
-        memTextures.resize(memCount, nullptr);
-        lastMemText.resize(memCount, "");
-    }
-
-    int x = 200;
-    int y = 10;
-    const int padding = 10;
-    const int windowWidth = 800;
-
-    for (int i = 0, addr = 0x200; static_cast<size_t>(addr) < (0x200 + chip8->getBufferSize()); i++, addr += 2)
-    {
-        char buffer[32];
-        snprintf(buffer, sizeof(buffer), "%04X: %02X%02X", addr, memory[addr], memory[addr + 1]);
-        std::string text(buffer);
-
-        if (!memTextures[i] || lastMemText[i] != text) {
-            if (memTextures[i]) SDL_DestroyTexture(memTextures[i]);
-            SDL_Surface *surface = TTF_RenderText_Solid(font, buffer, white);
-            memTextures[i] = SDL_CreateTextureFromSurface(debugRenderer, surface);
-            SDL_FreeSurface(surface);
-            lastMemText[i] = text;
-        }
+    renderText(10, 20 * 20, buffer, white);
+
+    // --- Debugger state and controls ---
+    SDL_Color status = frame.paused ? SDL_Color{255, 200, 0, 255} : white;
+    renderText(10, 20 * 22, frame.paused ? frame.breakReason : "running", status);
+    renderText(10, 20 * 24, "F5 run/pause", white);
+    renderText(10, 20 * 25, "F9 breakpoint", white);
+    renderText(10, 20 * 26, "F10 step over", white);
+    renderText(10, 20 * 27, "F11 step", white);
+    renderText(10, 20 * 28, "F7 heat map", white);
+
+    // --- Input to photon latency per stage ---
+    for (int s = 0; s < Chip8LatencyStats::STAGES; ++s)
+    {
+        char line[112];
+        char stats[96];
+        latency.stage(s).format(stats, sizeof(stats));
+        snprintf(line, sizeof(line), "%-8s %s", Chip8LatencyStats::stageName(s), stats);
+        renderText(10, 600 + 20 * s, line, white);
+    }
+    if (frame.runAhead > 0)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "run-ahead %d frames, %.3f ms per frame", frame.runAhead, frame.runAheadNs / 1e6);
+        renderText(10, 600 + 20 * Chip8LatencyStats::STAGES, line, white);
+    }
 
-        int textWidth = 0, textHeight = 0;
-        TTF_SizeText(font, buffer, &textWidth, &textHeight);
-        SDL_Rect destRect = {x, y, textWidth, textHeight};
-        SDL_RenderCopy(debugRenderer, memTextures[i], nullptr, &destRect);
+    // --- Memory heat map ---
+    if (frame.heatOn) renderHeatMap(frame);
+    heatWasOn = frame.heatOn;
 
-        x += textWidth + padding;
-        if (x + textWidth > windowWidth - padding)
-        {
-            x = 200;
-            y += 20;
-        }
-    }
+    // --- Disassembly listing, only the lines on screen are formatted ---
+    const std::vector<Chip8Disassembler::Line> &listing = frame.listing;
+
+    // Scroll so the current instruction stays in the first column
+    const int columnX[2] = {200, 500};
+    const int rowsPerColumn = 29;
+    size_t pcLine = 0;
+    while (pcLine + 1 < listing.size() && listing[pcLine + 1].addr <= pc) pcLine++;
+    size_t first = (pcLine > rowsPerColumn / 2) ? pcLine - rowsPerColumn / 2 : 0;
 
-    // --- Highlight the current instruction ---
-    x = 200;
-    y = 10;
-    for (int i = 0, addr = 0x200; static_cast<size_t>(addr) < (0x200 + chip8->getBufferSize()); i++, addr += 2)
+    for (size_t i = first; i < listing.size() && i < first + 2 * rowsPerColumn; ++i)
     {
-        if (addr == pc)
-        {
-            char buffer[32];
-            snprintf(buffer, sizeof(buffer), "%04X: %02X%02X", addr, memory[addr], memory[addr + 1]);
-            SDL_Color highlight = {255, 0, 0, 255};
-            renderText(debugRenderer, x, y, buffer, highlight);
-            break;
-        }
-        int textWidth = 0;
-        TTF_SizeText(font, lastMemText[i].c_str(), &textWidth, nullptr);
-        x += textWidth + padding;
-        if (x + textWidth > windowWidth - padding)
-        {
-            x = 200;
-            y += 20;
+        const int row = static_cast<int>(i - first);
+        const int x = columnX[row / rowsPerColumn];
+        const int y = 10 + 20 * (row % rowsPerColumn);
+
+        if (frame.breakpoints[listing[i].addr & 0x0FFF]) {
+            // Breakpoint marker left of the line
+            SDL_Rect marker = {x - 10, y + 5, 6, 6};
+            SDL_SetRenderDrawColor(debugRenderer, 255, 0, 0, 255);
+            SDL_RenderFillRect(debugRenderer, &marker);
         }
+
+        // Highlight the current instruction
+        const SDL_Color highlight = {255, 0, 0, 255};
+        Chip8Disassembler::formatLine(frame.state.memory, listing[i], buffer, sizeof(buffer));
+        renderText(x, y, buffer, listing[i].addr == pc ? highlight : white);
     }
 
     SDL_RenderPresent(debugRenderer);
 }
 
-void Chip8GFX::renderText(SDL_Renderer *renderer, int x, int y, const char *text, SDL_Color color)
+// 4K as 64x64, reads green and writes red, one texture upload per refresh
+void Chip8GFX::renderHeatMap(const Chip8Frame &frame)
 {
-    // Create surface from text
-    SDL_Surface *surfaceMessage = TTF_RenderText_Solid(font, text, color);
-    if (surfaceMessage == nullptr)
+    if (heatTexture == nullptr)
     {
-        std::cerr << "TTF_RenderText_Solid Error: " << TTF_GetError() << std::endl;
-        return;
+        Chip8AllocCheck::Allow allow;
+        heatTexture = SDL_CreateTexture(debugRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64, 64);
+        if (heatTexture == nullptr)
+        {
+            std::cerr << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
+            return;
+        }
     }
 
-    // Create texture from surface
-    SDL_Texture *message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
-    if (message == nullptr)
+    if (!heatWasOn)
     {
-        std::cerr << "SDL_CreateTextureFromSurface Error: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(surfaceMessage);
-        return;
+        // the core restarted its totals
+        memset(heatRead, 0, sizeof(heatRead));
+        memset(heatWrite, 0, sizeof(heatWrite));
+        memset(lastHeatReads, 0, sizeof(lastHeatReads));
+        memset(lastHeatWrites, 0, sizeof(lastHeatWrites));
     }
 
-    // Get width and height of the texture
-    int text_width = surfaceMessage->w;
-    int text_height = surfaceMessage->h;
+    // fold in the accesses since the last frame we saw, older ones fade by
+    // the emulated frames in between, however many this window got to see
+    if (frame.state.cycles != heatCycles)
+    {
+        const double frames = frame.state.cycles > heatCycles
+            ? static_cast<double>(frame.state.cycles - heatCycles) * 60.0 / frame.clockRate
+            : 0.0; // rewound or restarted, nothing to fade
+        const float decay = static_cast<float>(std::pow(HEAT_DECAY, frames));
+        for (int a = 0; a < 4096; ++a)
+        {
+            heatRead[a] = heatRead[a] * decay + (frame.heatReads[a] - lastHeatReads[a]);
+            heatWrite[a] = heatWrite[a] * decay + (frame.heatWrites[a] - lastHeatWrites[a]);
+        }
+        memcpy(lastHeatReads, frame.heatReads, sizeof(lastHeatReads));
+        memcpy(lastHeatWrites, frame.heatWrites, sizeof(lastHeatWrites));
+        heatCycles = frame.state.cycles;
+    }
 
-    SDL_FreeSurface(surfaceMessage);
+    void *texels;
+    int pitch;
+    if (SDL_LockTexture(heatTexture, nullptr, &texels, &pitch) != 0) return;
+    for (int y = 0; y < 64; ++y)
+    {
+        Uint32 *row = reinterpret_cast<Uint32 *>(static_cast<unsigned char *>(texels) + y * pitch);
+        for (int x = 0; x < 64; ++x)
+        {
+            // log scale, a byte touched once still shows
+            const int a = y * 64 + x;
+            const Uint32 r = static_cast<Uint32>(std::min(255.0f, 32.0f * std::log2(1.0f + heatWrite[a])));
+            const Uint32 g = static_cast<Uint32>(std::min(255.0f, 32.0f * std::log2(1.0f + heatRead[a])));
+            row[x] = r << 24 | g << 16 | 0x20 << 8 | 0xFF;
+        }
+    }
+    SDL_UnlockTexture(heatTexture);
 
-    // Define destination rectangle
-    SDL_Rect destRect;
-    destRect.x = x;
-    destRect.y = y;
-    destRect.w = text_width;
-    destRect.h = text_height;
+    SDL_Rect destRect = {640, 588, 128, 128};
+    SDL_RenderCopy(debugRenderer, heatTexture, nullptr, &destRect);
+}
 
-    // Render the text
-    SDL_RenderCopy(renderer, message, nullptr, &destRect);
+void Chip8GFX::renderText(int x, int y, const char *text, SDL_Color color)
+{
+    // One copy per character from the glyph cache, tinted to the color
+    for (const char *c = text; *c; ++c)
+    {
+        int g = static_cast<unsigned char>(*c) - FIRST_GLYPH;
+        if (g < 0 || g >= GLYPHS) g = '?' - FIRST_GLYPH;
 
-    // Clean up
-    SDL_DestroyTexture(message);
+        if (glyphs[g])
+        {
+            SDL_SetTextureColorMod(glyphs[g], color.r, color.g, color.b);
+            SDL_Rect destRect = {x, y, glyphSize[g].w, glyphSize[g].h};
+            SDL_RenderCopy(debugRenderer, glyphs[g], nullptr, &destRect);
+        }
+        x += glyphSize[g].w;
+    }
 }
-
-void Chip8GFX::clearDisplay() {
-    // Clear the graphics buffer
-    memset(display, 0, 64 * 32 * sizeof(unsigned char));
-    
-    // Clear the renderer
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer); // Present the cleared renderer
-}
\ No newline at end of file
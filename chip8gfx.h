@@ -6,51 +6,88 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include "chip8display.h"
 
 
-class Chip8; // Forward declaration of Chip8 class
-
-class Chip8GFX
+// Runs on the render thread and only ever sees frames the core published
+class Chip8GFX : public Chip8Display
 {
 public:
     // Constructor
-    Chip8GFX(Chip8* chip8); // Constructor takes a pointer to Chip8
+    Chip8GFX();
 
     // Initialize the system, clear the memory, registers, and screen
     void initialize();
 
-    void drawGraphics();
-
-    void cleanUp();
+    void drawGraphics(const Chip8Frame &frame) override;
 
-    // Debugging functions
-    void initializeDebugWindow();
-    void renderDebugInfo();
-    void renderText(SDL_Renderer *renderer, int x, int y, const char *text, SDL_Color color);
+    // Palette, window or debugger changed, draw the last frame again
+    bool needsRedraw() const override { return redraw; }
 
+    // Window and keyboard events, keys and debugger commands go to the core through link
+    void handleEvents(Chip8Link &link) override;
 
-    void clearDisplay();
+    // Display colors as 0xRRGGBBAA, or a palette name / "RRGGBB,RRGGBB" (on,off).
+    // XO-CHIP adds plane 2 and both planes, "RRGGBB,RRGGBB,RRGGBB,RRGGBB"
+    // gives them too, otherwise they are blends of on and off
+    void setPalette(Uint32 on, Uint32 off, Uint32 plane2, Uint32 both);
+    bool setPalette(const char *spec);
+    static const char *paletteNames();
 
-private:
-    Chip8* chip8; // Store pointer to Chip8 for access
+    // Alt+Enter, borderless full screen at the desktop resolution
+    void toggleFullscreen();
 
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    SDL_Texture* gfxTexture = nullptr;
+    void cleanUp() override;
 
-    SDL_Window *debugWindow;
-    SDL_Renderer *debugRenderer;
-    TTF_Font *font; // Font for rendering text
+    // Debugging functions, the window and font are created on first use
+    void toggleDebugWindow();
+    bool isDebugWindowVisible() const { return debugVisible; }
+    void renderDebugInfo(const Chip8Frame &frame);
+    void renderText(int x, int y, const char *text, SDL_Color color);
+    void renderHeatMap(const Chip8Frame &frame);
 
+    // Keyboard events from this window drive the debugger
+    Uint32 getDebugWindowID() { return debugWindow ? SDL_GetWindowID(debugWindow) : 0; }
 
-    // Textures for registers
-    std::string lastRegisterText[16];
-    SDL_Texture* registerTextures[16] = {nullptr};
+    // Key press to present times, shown in the debugger
+    const Chip8LatencyStats &getLatency() const override { return latency; }
 
-    std::vector<std::string> lastMemText;
-    std::vector<SDL_Texture*> memTextures;
+private:
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture* gfxTexture = nullptr;
 
-    unsigned char* display;
+    SDL_Window *debugWindow = nullptr;
+    SDL_Renderer *debugRenderer = nullptr;
+    TTF_Font *font = nullptr; // Font for rendering text
+    bool debugVisible = false;
+    bool redraw = true;
+
+    bool initializeDebugWindow();
+
+
+    // Printable ASCII rendered once when the debugger opens, text is drawn
+    // glyph by glyph from these so a frame doesn't touch the heap
+    static const int FIRST_GLYPH = 32, GLYPHS = 95;
+    SDL_Texture* glyphs[GLYPHS] = {nullptr};
+    SDL_Rect glyphSize[GLYPHS];
+
+    // RGBA for every combination of 8 horizontal pixels
+    Uint32 expandLUT[256][8];
+    Uint32 colors[4]; // by XO-CHIP pixel value, off, plane 1, plane 2, both
+
+    Chip8LatencyStats latency;
+    unsigned long lastTraceId = 0;
+
+    // Memory heat map, decayed access counts per byte
+    static constexpr double HEAT_DECAY = 0.94; // per emulated frame, fades in about a second
+    SDL_Texture* heatTexture = nullptr;
+    float heatRead[4096] = {0};
+    float heatWrite[4096] = {0};
+    unsigned int lastHeatReads[4096] = {0};
+    unsigned int lastHeatWrites[4096] = {0};
+    unsigned long long heatCycles = 0;
+    bool heatWasOn = false;
 
 };
 
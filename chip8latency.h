@@ -0,0 +1,145 @@
+#ifndef CHIP8LATENCY_H
+#define CHIP8LATENCY_H
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+/*
+ * Input to photon latency.
+ *
+ * A key press is stamped when SDL queued it and again at every stage on its
+ * way to the screen: the core applying it, the first EX9E/EXA1/FX0A that
+ * sees it, the first DXYN after that which changes the display, and the
+ * SDL_RenderPresent that shows the frame. One press is in flight at a time,
+ * a newer one replaces it. The render thread keeps a histogram per stage.
+ */
+
+// Steady clock in nanoseconds, the same on every thread
+inline long long chip8Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Where one key press has got to, 0 for stages it hasn't reached
+struct Chip8KeyTrace
+{
+    unsigned long id = 0; // new for every traced press
+    unsigned char key = 0;
+    long long event = 0;    // SDL queued the key event
+    long long applied = 0;  // core called setKey
+    long long observed = 0; // the program tested the key
+    long long drawn = 0;    // the program drew in response
+};
+
+// Log scale histogram of durations, 4 buckets per octave of microseconds
+class Chip8LatencyHistogram
+{
+public:
+    void add(long long ns)
+    {
+        const unsigned long long us = ns > 0 ? static_cast<unsigned long long>(ns) / 1000 : 0;
+        ++buckets[bucketOf(us)];
+        ++count;
+        maxUs = std::max(maxUs, us);
+    }
+
+    unsigned long getCount() const { return count; }
+
+    // Upper bound in microseconds under which a fraction p of the samples fall
+    unsigned long long percentile(double p) const
+    {
+        const unsigned long target = static_cast<unsigned long>(p * count);
+        unsigned long seen = 0;
+        for (int b = 0; b < BUCKETS; ++b)
+        {
+            seen += buckets[b];
+            if (seen > target) return std::min(bucketLow(b + 1), maxUs);
+        }
+        return maxUs;
+    }
+
+    // "p50 1.2 p95 3.4 p99 5.6 max 7.8 ms"
+    void format(char *out, size_t size) const
+    {
+        if (count == 0)
+        {
+            snprintf(out, size, "-");
+            return;
+        }
+        snprintf(out, size, "p50 %.1f p95 %.1f p99 %.1f max %.1f ms (%lu)",
+                 percentile(0.50) / 1000.0, percentile(0.95) / 1000.0, percentile(0.99) / 1000.0,
+                 maxUs / 1000.0, count);
+    }
+
+private:
+    static const int BUCKETS = 100; // up to 2^26 us, over a minute
+
+    unsigned long buckets[BUCKETS] = {0};
+    unsigned long count = 0;
+    unsigned long long maxUs = 0;
+
+    static int bucketOf(unsigned long long us)
+    {
+        if (us < 4) return static_cast<int>(us);
+        const int octave = 63 - __builtin_clzll(us);
+        const int sub = static_cast<int>(us >> (octave - 2)) & 3;
+        return std::min((octave - 1) * 4 + sub, BUCKETS - 1);
+    }
+
+    static unsigned long long bucketLow(int b)
+    {
+        if (b < 4) return b;
+        return (4ull + b % 4) << (b / 4 - 1);
+    }
+};
+
+// The stages of a press, each one the time since the previous stamp
+class Chip8LatencyStats
+{
+public:
+    enum Stage
+    {
+        QUEUE,   // event -> setKey: render loop, input ring and the core's sleep
+        POLL,    // setKey -> key test: waiting for the frame and for the program to look
+        DRAW,    // key test -> DXYN: the program's own reaction
+        PRESENT, // DXYN -> present: end of the frame, triple buffer and vsync
+        TOTAL,
+        STAGES
+    };
+
+    // A frame showing a drawn press was presented at the given time
+    void record(const Chip8KeyTrace &trace, long long presented)
+    {
+        stages[QUEUE].add(trace.applied - trace.event);
+        stages[POLL].add(trace.observed - trace.applied);
+        stages[DRAW].add(trace.drawn - trace.observed);
+        stages[PRESENT].add(presented - trace.drawn);
+        stages[TOTAL].add(presented - trace.event);
+    }
+
+    const Chip8LatencyHistogram &stage(int s) const { return stages[s]; }
+    static const char *stageName(int s)
+    {
+        static const char *const NAMES[STAGES] = {"queue", "poll", "draw", "present", "total"};
+        return NAMES[s];
+    }
+
+    void report(FILE *out) const
+    {
+        if (stages[TOTAL].getCount() == 0) return;
+        fprintf(out, "Input to photon latency:\n");
+        for (int s = 0; s < STAGES; ++s)
+        {
+            char line[96];
+            stages[s].format(line, sizeof(line));
+            fprintf(out, "  %-8s %s\n", stageName(s), line);
+        }
+    }
+
+private:
+    Chip8LatencyHistogram stages[STAGES];
+};
+
+#endif // CHIP8LATENCY_H
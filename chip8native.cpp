@@ -0,0 +1,79 @@
+#include "chip8native.h"
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <dlfcn.h>
+
+/**
+ * Native ROM loader - resolves the chip8c exports and checks the ABI
+ */
+
+Chip8Native::~Chip8Native()
+{
+    unload();
+}
+
+bool Chip8Native::load(const char *path)
+{
+    unload();
+
+    // without a slash dlopen searches the library path instead of the current directory
+    const std::string file = strchr(path, '/') ? path : std::string("./") + path;
+    handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+    {
+        std::cerr << "dlopen Error: " << dlerror() << std::endl;
+        return false;
+    }
+
+    typedef int (*AbiFn)();
+    typedef const unsigned char *(*DataFn)();
+    AbiFn abi = reinterpret_cast<AbiFn>(dlsym(handle, "chip8_native_abi"));
+    DataFn imageFn = reinterpret_cast<DataFn>(dlsym(handle, "chip8_native_image"));
+    DataFn codeFn = reinterpret_cast<DataFn>(dlsym(handle, "chip8_native_code"));
+    runFn = reinterpret_cast<Chip8NativeRun>(dlsym(handle, "chip8_native_run"));
+
+    if (abi == nullptr || imageFn == nullptr || codeFn == nullptr || runFn == nullptr)
+    {
+        std::cerr << path << " is not a chip8c ROM" << std::endl;
+        unload();
+        return false;
+    }
+    if (abi() != CHIP8_NATIVE_ABI)
+    {
+        std::cerr << path << " was built for native ABI " << abi() << ", rebuild it with this chip8c" << std::endl;
+        unload();
+        return false;
+    }
+
+    image = imageFn();
+    code = codeFn();
+
+    for (unsigned int a = 0; a < 4096; ++a)
+    {
+        if (!(code[a >> 3] >> (a & 7) & 1)) continue;
+        if (!runs.empty() && runs.back().second == a) runs.back().second = a + 1;
+        else runs.push_back(std::make_pair(static_cast<unsigned short>(a), static_cast<unsigned short>(a + 1)));
+    }
+    return true;
+}
+
+void Chip8Native::unload()
+{
+    if (handle) dlclose(handle);
+    handle = nullptr;
+    runFn = nullptr;
+    image = code = nullptr;
+    runs.clear();
+}
+
+bool Chip8Native::matches(const unsigned char *memory) const
+{
+    if (handle == nullptr) return false;
+
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        if (memcmp(memory + runs[i].first, image + runs[i].first, runs[i].second - runs[i].first) != 0) return false;
+    }
+    return true;
+}
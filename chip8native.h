@@ -0,0 +1,98 @@
+#ifndef CHIP8NATIVE_H
+#define CHIP8NATIVE_H
+
+/*
+ * Ahead of time compiled ROMs (see chip8c.cpp).
+ *
+ * chip8c translates the code the disassembler can reach into C++ and builds
+ * it as a shared object exporting
+ *
+ *   int chip8_native_abi()                      CHIP8_NATIVE_ABI it was built against
+ *   const unsigned char *chip8_native_image()   the 4K memory image it was compiled from
+ *   const unsigned char *chip8_native_code()    code bitmap, bit (a & 7) of byte a / 8
+ *   int chip8_native_run(Chip8NativeContext *c, int cycles)
+ *
+ * chip8_native_run executes up to cycles instructions with exactly the
+ * interpreter's semantics and returns how many it executed. It stops early
+ * wherever it can't continue natively (uncompiled address, BNNN into code the
+ * analysis never saw, a guard the interpreter handles), so a short count
+ * means "run the instruction at pc through emulateCycle".
+ *
+ * The generated source includes this header with CHIP8_NATIVE_GENERATED
+ * defined and only needs the context from it.
+ */
+
+#define CHIP8_NATIVE_ABI 2
+
+#ifndef CHIP8_NATIVE_GENERATED
+#include <vector>
+#include <utility>
+#endif
+
+// The machine state the native code works on, pointers into a Chip8
+struct Chip8NativeContext
+{
+    unsigned char *memory;
+    unsigned char *V;
+    unsigned short *I;
+    unsigned short *pc;
+    unsigned short *stack;
+    unsigned short *sp;
+    const unsigned char *key;
+    unsigned long long cycle; // cycles executed before this run, the timers follow it
+
+    // everything that touches the display, the timers, the RNG or the host goes back to the Chip8
+    // timer calls pass the cycle of the instruction doing the access, sound is 0 for DT, 1 for ST
+    void *host;
+    void (*clear)(void *host);
+    unsigned char (*draw)(void *host, unsigned short addr, unsigned int x, unsigned int y, unsigned int n);
+    unsigned char (*random)(void *host);
+    unsigned char (*readTimer)(void *host, int sound, unsigned long long cycle);
+    void (*writeTimer)(void *host, int sound, unsigned long long cycle, unsigned char value);
+    void (*written)(void *host, unsigned short addr, unsigned short len);
+
+    int codeWritten; // set when FX33/FX55 wrote into compiled code
+};
+
+typedef int (*Chip8NativeRun)(Chip8NativeContext *c, int cycles);
+
+#ifndef CHIP8_NATIVE_GENERATED
+
+// Loads a chip8c shared object
+class Chip8Native
+{
+public:
+    ~Chip8Native();
+
+    bool load(const char *path);
+    void unload();
+    bool isLoaded() const { return handle != nullptr; }
+
+    int run(Chip8NativeContext *c, int cycles) { return runFn(c, cycles); }
+
+    // True if every compiled byte in memory is still what it was compiled from
+    bool matches(const unsigned char *memory) const;
+
+    // True if a write to [addr, addr + len) changes compiled code
+    bool touchesCode(unsigned int addr, unsigned int len) const
+    {
+        for (unsigned int a = addr; a < addr + len && a < 4096; ++a)
+        {
+            if (code[a >> 3] >> (a & 7) & 1) return true;
+        }
+        return false;
+    }
+
+private:
+    void *handle = nullptr;
+    Chip8NativeRun runFn = nullptr;
+    const unsigned char *image = nullptr;
+    const unsigned char *code = nullptr;
+
+    // compiled code as [start, end) runs, so matches is a few memcmps
+    std::vector<std::pair<unsigned short, unsigned short> > runs;
+};
+
+#endif // CHIP8_NATIVE_GENERATED
+
+#endif // CHIP8NATIVE_H
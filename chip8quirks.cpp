@@ -0,0 +1,317 @@
+#include "chip8quirks.h"
+#include "chip8latency.h"
+#include "logger.h"
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/stat.h>
+
+/**
+ * Quirk detection - every profile runs the ROM on its own thread, checked
+ * before each instruction, and the cheapest one is kept per ROM hash
+ */
+
+namespace
+{
+
+const unsigned int SEED = 0xC8C8C8C8u; // CXNN gives every profile the same numbers
+
+// what a profile is charged, see chip8quirks.h
+const int CRASH = 100;
+const int STACK = 50;
+const int HALTED_BLANK = 20;
+const int GARBLED = 2;
+const int GARBLED_MAX = 60;
+const int OUT_OF_RANGE = 1;
+const int OUT_OF_RANGE_MAX = 30;
+
+struct Run
+{
+    Chip8Quirks quirks;
+    int penalty = 0;
+    int garbled = 0;
+    int outOfRange = 0;
+    const char *reason = nullptr; // the first thing charged
+    unsigned long long outcome = 0;
+};
+
+unsigned long long fnv(unsigned long long h, const unsigned char *p, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+void charge(Run &run, int cost, const char *reason)
+{
+    run.penalty += cost;
+    if (!run.reason) run.reason = reason;
+}
+
+// From the second second on every key in turn, held 10 frames out of 20, -1 for none
+int scriptedKey(int frame)
+{
+    if (frame < 60) return -1;
+    frame -= 60;
+    return (frame % 20 < 10) ? (frame / 20) % 16 : -1;
+}
+
+void runProfile(Run &run, const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing, long long deadline)
+{
+    std::unique_ptr<Chip8> chip8(new Chip8()); // 64K of memory, not for a worker's stack
+    chip8->setTiming(timing);
+    chip8->setXOChip(xoChip);
+    chip8->setQuirks(run.quirks);
+    chip8->initialize();
+    if (!chip8->loadROM(rom, size)) return;
+    chip8->seedRandom(SEED);
+
+    const unsigned int mask = xoChip ? 0xFFFF : 0x0FFF;
+    const unsigned int romEnd = 0x200 + static_cast<unsigned int>(size);
+    const unsigned char *memory = chip8->getMemory();
+    std::vector<unsigned char> written(mask + 1, 0), executed(mask + 1, 0);
+
+    // the font, the ROM and whatever the program stored itself
+    auto known = [&](unsigned int a) { return a < 0x50 || (a >= 0x200 && a < romEnd) || written[a]; };
+    auto stores = [&](unsigned int from, unsigned int len)
+    {
+        if (from + len - 1 > mask && run.outOfRange < OUT_OF_RANGE_MAX)
+        {
+            run.outOfRange += OUT_OF_RANGE;
+            charge(run, OUT_OF_RANGE, "I ran past the end of memory");
+        }
+        for (unsigned int i = 0; i < len; ++i) written[(from + i) & mask] = 1;
+    };
+
+    int key = -1;
+    bool done = false;
+    for (int frame = 0; frame < Chip8QuirkDetect::ANALYSIS_FRAMES && !done; ++frame)
+    {
+        const int next = scriptedKey(frame);
+        if (next != key)
+        {
+            if (key >= 0) chip8->setKey(key, 0);
+            if (next >= 0) chip8->setKey(next, 1);
+            key = next;
+        }
+
+        const unsigned long long end = chip8->getCycles() + chip8->cyclesToNextTick();
+        while (!done && chip8->getCycles() < end)
+        {
+            const unsigned int pc = chip8->getPC() & mask;
+            const unsigned short opcode = memory[pc] << 8 | memory[(pc + 1) & mask];
+            const unsigned int I = chip8->getI();
+            const unsigned int x = (opcode & 0x0F00) >> 8;
+            const unsigned int y = (opcode & 0x00F0) >> 4;
+
+            if (!known(pc))
+            {
+                charge(run, CRASH, "ran outside the program");
+                done = true;
+                break;
+            }
+            executed[pc] = executed[(pc + 1) & mask] = 1;
+
+            switch (opcode & 0xF000)
+            {
+            case 0x0000:
+                if (opcode == 0x00EE && chip8->getSP() == 0)
+                {
+                    charge(run, STACK, "stack underflow");
+                    done = true;
+                }
+                break;
+            case 0x1000:
+                if ((opcode & 0x0FFF) == pc)
+                {
+                    // halted, nothing changes from here on
+                    const unsigned char *gfx = chip8->getDisplayBuffer();
+                    bool blank = true;
+                    for (int i = 0; i < 64 * 32 && blank; ++i) blank = gfx[i] == 0;
+                    if (blank) charge(run, HALTED_BLANK, "halted on a blank display");
+                    done = true;
+                }
+                break;
+            case 0x2000:
+                if (chip8->getSP() >= 16)
+                {
+                    charge(run, STACK, "stack overflow");
+                    done = true;
+                }
+                break;
+            case 0x5000:
+                if (xoChip && (opcode & 0x000F) == 0x0002) // 5XY2 saves VX to VY
+                    stores(I, (x < y ? y - x : x - y) + 1);
+                break;
+            case 0xD000:
+            {
+                const unsigned int planes = std::bitset<2>(chip8->getPlanes()).count();
+                const unsigned int rows = (opcode & 0x000F) * planes;
+                bool garbled = false;
+                for (unsigned int r = 0; r < rows; ++r)
+                {
+                    const unsigned int a = (I + r) & mask;
+                    garbled = garbled || !known(a) || executed[a];
+                }
+                if (garbled && run.garbled < GARBLED_MAX)
+                {
+                    run.garbled += GARBLED;
+                    charge(run, GARBLED, "garbled sprites");
+                }
+                break;
+            }
+            case 0xF000:
+                if ((opcode & 0x00FF) == 0x33) stores(I, 3);
+                else if ((opcode & 0x00FF) == 0x55) stores(I, x + 1);
+                else if ((opcode & 0x00FF) == 0x65 && I + x > mask && run.outOfRange < OUT_OF_RANGE_MAX)
+                {
+                    run.outOfRange += OUT_OF_RANGE;
+                    charge(run, OUT_OF_RANGE, "I ran past the end of memory");
+                }
+                break;
+            }
+
+            chip8->emulateCycle();
+
+            // only FX0A waits in place on purpose, anything else stuck is no instruction at all
+            if (!done && (chip8->getPC() & mask) == pc && (opcode & 0xF0FF) != 0xF00A &&
+                (opcode & 0xF000) != 0x1000 && (opcode & 0xF000) != 0xB000)
+            {
+                charge(run, CRASH, "ran an instruction that doesn't exist");
+                done = true;
+            }
+        }
+        done = done || chip8Now() > deadline;
+    }
+
+    unsigned long long h = fnv(0xCBF29CE484222325ull, chip8->getDisplayBuffer(), 64 * 32);
+    h = fnv(h, chip8->getV(), 16);
+    const unsigned short regs[2] = {chip8->getI(), chip8->getPC()};
+    run.outcome = fnv(h, reinterpret_cast<const unsigned char *>(regs), sizeof(regs));
+}
+
+} // namespace
+
+Chip8QuirkDetect::Result Chip8QuirkDetect::analyze(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing)
+{
+    Result result;
+    const long long start = chip8Now();
+
+    std::vector<Run> runs(Chip8Quirks::COUNT);
+    for (int i = 0; i < Chip8Quirks::COUNT; ++i) runs[i].quirks = Chip8Quirks::fromIndex(i);
+
+    std::atomic<int> next(0);
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > static_cast<unsigned int>(Chip8Quirks::COUNT)) threads = Chip8Quirks::COUNT;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]
+        {
+            Logger::Mute mute; // the runs hit unknown opcodes on purpose, not worth a warning
+            for (int i; (i = next++) < Chip8Quirks::COUNT;)
+                runProfile(runs[i], rom, size, xoChip, timing, start + TIME_LIMIT);
+        });
+    }
+    for (std::thread &worker : workers) worker.join();
+
+    // the cheapest, with the fewest quirks on among equals
+    int best = 0;
+    for (int i = 1; i < Chip8Quirks::COUNT; ++i)
+    {
+        if (runs[i].penalty < runs[best].penalty ||
+            (runs[i].penalty == runs[best].penalty && std::bitset<4>(i).count() < std::bitset<4>(best).count()))
+            best = i;
+    }
+
+    result.outcomes = 0;
+    for (int i = 0; i < Chip8Quirks::COUNT; ++i)
+    {
+        int j = 0;
+        while (runs[j].outcome != runs[i].outcome) ++j;
+        if (j == i) ++result.outcomes;
+    }
+    if (result.outcomes == 1) best = 0; // the quirks never mattered
+
+    result.quirks = runs[best].quirks;
+    if (best != 0 && runs[0].reason) result.reason = runs[0].reason;
+    result.seconds = (chip8Now() - start) / 1e9;
+    return result;
+}
+
+Chip8QuirkDetect::Result Chip8QuirkDetect::detect(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing)
+{
+    const unsigned long long hash = hashROM(rom, size, xoChip, timing);
+    Result result;
+    if (loadCached(hash, result.quirks))
+    {
+        result.cached = true;
+        return result;
+    }
+
+    result = analyze(rom, size, xoChip, timing);
+    storeCached(hash, result.quirks);
+    return result;
+}
+
+// $XDG_CACHE_HOME/chip8/quirks or ~/.cache/chip8/quirks, empty without either
+std::string Chip8QuirkDetect::cachePath()
+{
+    std::string dir;
+    if (const char *xdg = getenv("XDG_CACHE_HOME"))
+        dir = xdg;
+    else if (const char *home = getenv("HOME"))
+        dir = std::string(home) + "/.cache";
+    if (dir.empty()) return dir;
+    return dir + "/chip8/quirks";
+}
+
+// The timing goes in too, the costs and the display wait change how a run ends
+unsigned long long Chip8QuirkDetect::hashROM(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing)
+{
+    const unsigned char mode[2] = {static_cast<unsigned char>(xoChip ? 1 : 0), static_cast<unsigned char>(timing.displayWait ? 1 : 0)};
+    unsigned long long h = fnv(0xCBF29CE484222325ull, mode, sizeof(mode));
+    h = fnv(h, reinterpret_cast<const unsigned char *>(&timing.clockRate), sizeof(timing.clockRate));
+    h = fnv(h, reinterpret_cast<const unsigned char *>(timing.cost), sizeof(timing.cost));
+    return fnv(h, rom, static_cast<size_t>(size));
+}
+
+// One "hash profile" line per ROM, the last one for a hash counts
+bool Chip8QuirkDetect::loadCached(unsigned long long hash, Chip8Quirks &quirks)
+{
+    const std::string path = cachePath();
+    FILE *file = path.empty() ? nullptr : fopen(path.c_str(), "r");
+    if (file == nullptr) return false;
+
+    bool found = false;
+    unsigned long long lineHash;
+    char name[64];
+    while (fscanf(file, "%llx %63s", &lineHash, name) == 2)
+    {
+        if (lineHash == hash && Chip8Quirks::parse(name, quirks)) found = true;
+    }
+    fclose(file);
+    return found;
+}
+
+void Chip8QuirkDetect::storeCached(unsigned long long hash, const Chip8Quirks &quirks)
+{
+    const std::string path = cachePath();
+    if (path.empty()) return;
+
+    // make the directories on the way, each one may already be there
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        if (mkdir(path.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) return;
+    }
+
+    FILE *file = fopen(path.c_str(), "a");
+    if (file == nullptr) return;
+    fprintf(file, "%016llx %s\n", hash, quirks.name().c_str());
+    fclose(file);
+}
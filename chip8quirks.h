@@ -0,0 +1,58 @@
+#ifndef CHIP8QUIRKS_H
+#define CHIP8QUIRKS_H
+
+#include <string>
+#include "chip8.h"
+
+/*
+ * Picks the quirk profile a ROM was written for.
+ *
+ * The ROM runs headless under all Chip8Quirks::COUNT profiles at once, one
+ * thread per profile up to the core count, for ANALYSIS_FRAMES frames of
+ * emulated time with a fixed random seed and the same scripted key presses
+ * everywhere. Every instruction is checked before it runs, and a profile is
+ * charged for what usually means the program went wrong under it:
+ *
+ *   - running code outside the ROM that the program never wrote, or an
+ *     instruction that doesn't exist (ends the run)
+ *   - a stack over or underflow (ends the run)
+ *   - halting on a jump to itself with nothing on the display (ends the run)
+ *   - drawing a sprite from memory that is neither the font, the ROM nor
+ *     written by the program, or from bytes that were run as code (garbled)
+ *   - an I based access running past the end of memory
+ *
+ * If every profile ends in the same state the ROM doesn't care and gets the
+ * default. Otherwise the cheapest profile wins, ties going to the one with
+ * the fewest quirks. The result is cached by a hash of the ROM and the
+ * timing it runs with, so only the first launch of a ROM under a timing
+ * pays for the analysis.
+ */
+class Chip8QuirkDetect
+{
+public:
+    struct Result
+    {
+        Chip8Quirks quirks;
+        bool cached = false;
+        int outcomes = 1;     // distinct end states across the profiles
+        double seconds = 0.0; // wall clock spent analyzing
+        std::string reason;   // what ruled the default out, empty if it won
+    };
+
+    // From the cache, or analyzed now and cached
+    static Result detect(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing);
+
+    // Always runs the analysis, leaves the cache alone
+    static Result analyze(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing);
+
+    static const int ANALYSIS_FRAMES = 600;         // 10 emulated seconds
+    static const long long TIME_LIMIT = 800000000LL; // ns, runs stop where they are after this
+
+private:
+    static std::string cachePath();
+    static unsigned long long hashROM(const unsigned char *rom, long size, bool xoChip, const Chip8Timing &timing);
+    static bool loadCached(unsigned long long hash, Chip8Quirks &quirks);
+    static void storeCached(unsigned long long hash, const Chip8Quirks &quirks);
+};
+
+#endif // CHIP8QUIRKS_H
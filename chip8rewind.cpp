@@ -0,0 +1,260 @@
+#include "chip8rewind.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * Rewind history - XOR runs against per second keyframes in a byte ring
+ */
+
+namespace
+{
+
+const size_t STATE_SIZE = sizeof(Chip8State);
+const size_t HEADER = 8;  // u32 size, u32 keyframe offset
+const size_t TRAILER = 4; // u32 size, to step back from the newest end
+
+inline unsigned int get32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline void put32(unsigned char *p, size_t v)
+{
+    const uint32_t u = static_cast<uint32_t>(v);
+    memcpy(p, &u, 4);
+}
+
+inline unsigned char *putVarint(unsigned char *out, size_t v)
+{
+    while (v >= 0x80)
+    {
+        *out++ = static_cast<unsigned char>(v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *out++ = static_cast<unsigned char>(v);
+    return out;
+}
+
+inline const unsigned char *getVarint(const unsigned char *in, size_t &v)
+{
+    v = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        v |= static_cast<size_t>(*in & 0x7F) << shift;
+        if (!(*in++ & 0x80)) return in;
+    }
+}
+
+} // namespace
+
+const size_t Chip8Rewind::MIN_CAPACITY;
+
+void Chip8Rewind::setCapacity(size_t bytes)
+{
+    if (bytes == 0)
+    {
+        std::vector<unsigned char>().swap(ring);
+        std::vector<unsigned char>().swap(encoded);
+    }
+    else
+    {
+        ring.assign(std::max(bytes, MIN_CAPACITY), 0);
+        encoded.resize(STATE_SIZE * 2 + 16); // alternating single bytes, the worst case
+    }
+    clear();
+}
+
+void Chip8Rewind::clear()
+{
+    head = tail = 0;
+    wrapAt = NONE;
+    count = used = 0;
+    keyOffset = NONE;
+    sinceKey = 0;
+}
+
+// Runs of current ^ reference (all zero without one) into encoded, returns the
+// length. Only current.used() is covered, the reference has the same memory size
+size_t Chip8Rewind::encode(const Chip8State &current, const Chip8State *reference)
+{
+    static const unsigned char ZERO[sizeof(Chip8State)] = {0};
+    const unsigned char *a = reinterpret_cast<const unsigned char *>(&current);
+    const unsigned char *b = reference ? reinterpret_cast<const unsigned char *>(reference) : ZERO;
+    unsigned char *out = encoded.data();
+    const size_t size = current.used();
+
+    size_t i = 0;
+    while (i < size)
+    {
+        // unchanged stretches are the common case, skip them 8 bytes at a time
+        size_t zeros = i;
+        while (zeros + 8 <= size)
+        {
+            uint64_t x, y;
+            memcpy(&x, a + zeros, 8);
+            memcpy(&y, b + zeros, 8);
+            if (x != y) break;
+            zeros += 8;
+        }
+        while (zeros < size && a[zeros] == b[zeros]) ++zeros;
+
+        size_t end = zeros;
+        while (end < size && a[end] != b[end]) ++end;
+
+        out = putVarint(out, zeros - i);
+        out = putVarint(out, end - zeros);
+        for (size_t j = zeros; j < end; ++j) *out++ = a[j] ^ b[j];
+        i = end;
+    }
+    return static_cast<size_t>(out - encoded.data());
+}
+
+// Runs until the entry ends, which is where the state's used() ended
+void Chip8Rewind::decode(size_t offset, Chip8State &out, const Chip8State *reference) const
+{
+    const unsigned char *in = ring.data() + offset + HEADER;
+    const unsigned char *end = ring.data() + offset + readSize(offset) - TRAILER;
+    unsigned char *dst = reinterpret_cast<unsigned char *>(&out);
+    const unsigned char *ref = reinterpret_cast<const unsigned char *>(reference);
+
+    size_t i = 0;
+    while (in < end)
+    {
+        size_t zeros, literals;
+        in = getVarint(in, zeros);
+        in = getVarint(in, literals);
+        if (ref) memcpy(dst + i, ref + i, zeros);
+        else memset(dst + i, 0, zeros);
+        i += zeros;
+        for (size_t j = 0; j < literals; ++j, ++i) dst[i] = *in++ ^ (ref ? ref[i] : 0);
+    }
+}
+
+unsigned int Chip8Rewind::readSize(size_t offset) const
+{
+    return get32(ring.data() + offset);
+}
+
+// Drops the oldest keyframe and the deltas against it
+void Chip8Rewind::dropOldest()
+{
+    do
+    {
+        if (tail == keyOffset) keyOffset = NONE; // the next record starts a keyframe
+        const size_t size = readSize(tail);
+        tail += size;
+        used -= size;
+        --count;
+        if (tail == wrapAt)
+        {
+            tail = 0;
+            wrapAt = NONE;
+        }
+    } while (count > 0 && get32(ring.data() + tail + 4) != tail);
+}
+
+// Contiguous room for an entry at head, making it by dropping old history
+unsigned char *Chip8Rewind::reserve(size_t size)
+{
+    for (;;)
+    {
+        if (count == 0)
+        {
+            head = tail = 0;
+            wrapAt = NONE;
+            return ring.data();
+        }
+        if (head > tail)
+        {
+            // live entries are tail..head, free space on both sides of them
+            if (head + size <= ring.size()) return ring.data() + head;
+            if (size <= tail)
+            {
+                wrapAt = head;
+                head = 0;
+                return ring.data();
+            }
+        }
+        else if (head + size <= tail)
+        {
+            // wrapped, the gap between the newest and the oldest
+            return ring.data() + head;
+        }
+        dropOldest();
+    }
+}
+
+void Chip8Rewind::record(const Chip8 &chip8)
+{
+    if (ring.empty()) return;
+
+    chip8.saveState(state);
+    bool keyframe = keyOffset == NONE || sinceKey >= KEYFRAME_INTERVAL || state.memorySize != keyState.memorySize;
+    size_t size = HEADER + encode(state, keyframe ? nullptr : &keyState) + TRAILER;
+    unsigned char *entry = reserve(size);
+    if (!keyframe && keyOffset == NONE)
+    {
+        // making room dropped our own keyframe, only in a tiny buffer
+        keyframe = true;
+        size = HEADER + encode(state, nullptr) + TRAILER;
+        entry = reserve(size);
+    }
+
+    const size_t offset = static_cast<size_t>(entry - ring.data());
+    if (keyframe)
+    {
+        keyOffset = offset;
+        memcpy(&keyState, &state, state.used());
+        sinceKey = 0;
+    }
+    put32(entry, size);
+    put32(entry + 4, keyOffset);
+    memcpy(entry + HEADER, encoded.data(), size - HEADER - TRAILER);
+    put32(entry + size - TRAILER, size);
+
+    head = offset + size;
+    ++count;
+    used += size;
+    ++sinceKey;
+}
+
+bool Chip8Rewind::rewind(Chip8 &chip8)
+{
+    if (count == 0) return false;
+
+    // the newest entry ends at head, or where head wrapped from
+    if (head == 0)
+    {
+        head = wrapAt;
+        wrapAt = NONE;
+    }
+    const size_t size = get32(ring.data() + head - TRAILER);
+    const size_t offset = head - size;
+    const size_t key = get32(ring.data() + offset + 4);
+
+    if (key != keyOffset)
+    {
+        decode(key, keyState, nullptr);
+        keyOffset = key;
+    }
+    if (offset == key)
+    {
+        memcpy(&state, &keyState, keyState.used());
+        keyOffset = NONE; // its space is free again
+    }
+    else
+    {
+        decode(offset, state, &keyState);
+    }
+
+    head = offset;
+    --count;
+    used -= size;
+    sinceKey = KEYFRAME_INTERVAL; // history continues from a fresh keyframe
+
+    chip8.loadState(state);
+    return true;
+}
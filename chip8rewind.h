@@ -0,0 +1,71 @@
+#ifndef CHIP8REWIND_H
+#define CHIP8REWIND_H
+
+#include <cstddef>
+#include <vector>
+#include "chip8.h"
+
+/*
+ * Rewind history, one Chip8State per emulated frame in a fixed size buffer.
+ *
+ * Every KEYFRAME_INTERVAL frames the whole state is stored, the frames in
+ * between only as their XOR against that keyframe. Nearly all of memory and
+ * most of the display stay the same across a second, so the XOR is mostly
+ * zeros and is stored as runs: varint zero count, varint literal count,
+ * literal bytes, until the state's used() bytes are covered, so a CHIP-8
+ * frame scans 4K of memory and not 64K. Keyframes are coded the same
+ * way against an all zero state. Any frame decodes from its keyframe and its
+ * own delta, no chain of deltas.
+ *
+ * Entries are appended to a byte ring as
+ *   u32 size, u32 keyframe offset, runs, u32 size
+ * and the oldest keyframe with its deltas is dropped when the ring is full,
+ * so memory stays at the capacity given. Rewinding takes entries off the
+ * newest end.
+ */
+class Chip8Rewind
+{
+public:
+    // Bytes of history, 0 turns rewinding off and frees the buffer
+    void setCapacity(size_t bytes);
+    bool isEnabled() const { return !ring.empty(); }
+
+    void clear();
+
+    // After every emulated frame
+    void record(const Chip8 &chip8);
+
+    // Go back one frame, taking it out of the history. False once it is empty
+    bool rewind(Chip8 &chip8);
+
+    size_t getFrames() const { return count; }
+    size_t getBytesUsed() const { return used; }
+
+    static const int KEYFRAME_INTERVAL = 60;
+
+private:
+    static const size_t NONE = ~static_cast<size_t>(0);
+    static const size_t MIN_CAPACITY = 256 * 1024; // a worst case keyframe with room to spare
+
+    std::vector<unsigned char> ring;
+    size_t head = 0;     // where the next entry goes
+    size_t tail = 0;     // oldest entry, always a keyframe
+    size_t wrapAt = NONE; // end of the entries before head went back to 0
+    size_t count = 0;
+    size_t used = 0;
+
+    size_t keyOffset = NONE; // keyframe the next delta is against, NONE = write a keyframe
+    int sinceKey = 0;
+
+    Chip8State state;    // record/rewind staging
+    Chip8State keyState; // decoded keyframe at keyOffset
+    std::vector<unsigned char> encoded;
+
+    size_t encode(const Chip8State &current, const Chip8State *reference);
+    void decode(size_t offset, Chip8State &out, const Chip8State *reference) const;
+    unsigned char *reserve(size_t size);
+    void dropOldest();
+    unsigned int readSize(size_t offset) const;
+};
+
+#endif // CHIP8REWIND_H
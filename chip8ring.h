@@ -0,0 +1,48 @@
+#ifndef CHIP8RING_H
+#define CHIP8RING_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Fixed size single producer / single consumer queue.
+ * push and pop never block or allocate, push fails when the queue is full.
+ */
+template <typename T, size_t N>
+class Chip8Ring
+{
+public:
+    // Producer side
+    bool push(const T &item)
+    {
+        const size_t head = headIdx.load(std::memory_order_relaxed);
+        if (head - tailIdx.load(std::memory_order_acquire) == N) return false;
+
+        items[head % N] = item;
+        headIdx.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &item)
+    {
+        const size_t tail = tailIdx.load(std::memory_order_relaxed);
+        if (tail == headIdx.load(std::memory_order_acquire)) return false;
+
+        item = items[tail % N];
+        tailIdx.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return tailIdx.load(std::memory_order_acquire) == headIdx.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[N];
+    std::atomic<size_t> headIdx{0};
+    std::atomic<size_t> tailIdx{0};
+};
+
+#endif // CHIP8RING_H
@@ -0,0 +1,138 @@
+#include "chip8shm.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/**
+ * Shared memory step interface - see chip8shm.h for the layout
+ */
+
+namespace
+{
+
+// an agent that steps in a loop is back well within this, after it we sleep
+const int SPIN = 4000;
+
+// spinning on one core only keeps the agent from running
+int spinLimit()
+{
+    static const int limit = std::thread::hardware_concurrency() > 1 ? SPIN : 0;
+    return limit;
+}
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static_assert(sizeof(Chip8ShmBlock) == 56 + 64 * 32, "layout documented in chip8shm.h");
+
+// not FUTEX_PRIVATE, the other side is another process
+void futexWait(std::atomic<uint32_t> *word, uint32_t value, int timeoutMs)
+{
+    timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+} // namespace
+
+Chip8SharedMemory::~Chip8SharedMemory()
+{
+    close();
+}
+
+bool Chip8SharedMemory::open(const char *name)
+{
+    shm_unlink(name); // stale segment from a previous run
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        std::perror("shm_open");
+        return false;
+    }
+    if (ftruncate(fd, sizeof(Chip8ShmBlock)) != 0)
+    {
+        std::perror("ftruncate");
+        ::close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *mem = mmap(nullptr, sizeof(Chip8ShmBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        std::perror("mmap");
+        shm_unlink(name);
+        return false;
+    }
+
+    // fresh pages are zero, which is already a valid idle state
+    block = static_cast<Chip8ShmBlock *>(mem);
+    block->version = CHIP8_SHM_VERSION;
+    block->magic = CHIP8_SHM_MAGIC;
+    this->name = name;
+    lastDone = 0;
+    frameCount = 0;
+    return true;
+}
+
+void Chip8SharedMemory::close()
+{
+    if (block == nullptr) return;
+    munmap(block, sizeof(Chip8ShmBlock));
+    shm_unlink(name.c_str());
+    block = nullptr;
+}
+
+bool Chip8SharedMemory::waitRequest(int timeoutMs)
+{
+    if (block == nullptr) return false;
+
+    for (int i = 0; i < spinLimit(); ++i)
+    {
+        if (block->request.load(std::memory_order_acquire) != lastDone) return true;
+        cpuRelax();
+    }
+
+    // announce the sleep before the last look, the agent checks it after its bump
+    block->serverWaiting.store(1, std::memory_order_seq_cst);
+    const uint32_t request = block->request.load(std::memory_order_seq_cst);
+    if (request == lastDone)
+    {
+        futexWait(&block->request, request, timeoutMs);
+    }
+    block->serverWaiting.store(0, std::memory_order_relaxed);
+    return block->request.load(std::memory_order_acquire) != lastDone;
+}
+
+void Chip8SharedMemory::finish(Chip8 &chip8, unsigned int framesRun)
+{
+    frameCount += framesRun;
+    memcpy(block->display, chip8.getDisplayBuffer(), sizeof(block->display));
+    block->sound = chip8.getSoundTimer() > 0;
+    block->frame = frameCount;
+    block->cycles = chip8.getCycles();
+
+    lastDone = block->request.load(std::memory_order_relaxed);
+    block->done.store(lastDone, std::memory_order_seq_cst);
+    if (block->clientWaiting.load(std::memory_order_seq_cst))
+    {
+        futexWake(&block->done);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef CHIP8SHM_H
+#define CHIP8SHM_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "chip8.h"
+
+/*
+ * Step interface for external agents in POSIX shared memory.
+ *
+ * The emulator creates the segment (shm_open name, mapped read/write by
+ * both sides) and waits. The agent fills in the command, then bumps
+ * request. The emulator runs it, writes the results, and sets done to the
+ * same value. The display is read straight out of the mapping.
+ *
+ * Both sides spin a little before sleeping on the other's counter with a
+ * futex, and only wake the other side when it said it sleeps. An agent
+ * that steps in a tight loop never makes a syscall.
+ *
+ * Layout, little endian, offsets in bytes (Chip8ShmBlock):
+ *   0    u32 magic          CHIP8_SHM_MAGIC
+ *   4    u32 version        CHIP8_SHM_VERSION
+ *   8    u32 request        agent: +1 after filling in the command (futex word)
+ *   12   u32 done           emulator: = request once finished (futex word)
+ *   16   u32 serverWaiting  emulator sleeps on request, FUTEX_WAKE it after the bump
+ *   20   u32 clientWaiting  agent sleeps on done, set it before FUTEX_WAIT
+ *   24   u32 command        0 = run frames, 1 = reset to the loaded ROM, 2 = quit
+ *   28   u32 frames         60Hz frames to run, 0 counts as 1
+ *   32   u32 keys           bit n = key n down, applied before running
+ *   36   u32 sound          sound timer running at the end
+ *   40   u64 frame          frames run since start
+ *   48   u64 cycles         Chip8::getCycles()
+ *   56   u8  display[2048]  64x32, one byte per pixel, rows top down
+ *                           (0/1, XO-CHIP bit 0 plane 1, bit 1 plane 2)
+ */
+
+#define CHIP8_SHM_MAGIC 0x4D533843u // "C8SM"
+#define CHIP8_SHM_VERSION 1
+
+struct Chip8ShmBlock
+{
+    uint32_t magic;
+    uint32_t version;
+
+    std::atomic<uint32_t> request;
+    std::atomic<uint32_t> done;
+    std::atomic<uint32_t> serverWaiting;
+    std::atomic<uint32_t> clientWaiting;
+
+    uint32_t command;
+    uint32_t frames;
+    uint32_t keys;
+
+    uint32_t sound;
+    uint64_t frame;
+    uint64_t cycles;
+    uint8_t display[64 * 32];
+};
+
+class Chip8SharedMemory
+{
+public:
+    enum Command { RUN = 0, RESET = 1, QUIT = 2 };
+
+    ~Chip8SharedMemory();
+
+    // Create the segment, replaces a stale one with the same name
+    bool open(const char *name);
+    void close();
+
+    // Wait up to timeoutMs for the agent's next command, false on timeout
+    bool waitRequest(int timeoutMs);
+
+    // The command to run, valid after waitRequest returned true
+    Command command() const { return static_cast<Command>(block->command); }
+    unsigned int frames() const { return block->frames ? block->frames : 1; }
+    unsigned int keys() const { return block->keys; }
+
+    // Publish the machine as it is now and hand control back to the agent
+    void finish(Chip8 &chip8, unsigned int framesRun);
+
+private:
+    Chip8ShmBlock *block = nullptr;
+    std::string name;
+    uint32_t lastDone = 0;
+    uint64_t frameCount = 0;
+};
+
+#endif // CHIP8SHM_H
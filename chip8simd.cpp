@@ -0,0 +1,778 @@
+#include "chip8simd.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Lockstep interpreter - every opcode mirrors Chip8::emulateCycle, but works
+ * on all lanes of the group at once. Lanes that are not in the group hold
+ * stale SoA data, so vector ops are free to write every lane unmasked.
+ */
+
+namespace
+{
+
+const unsigned int ALL_LANES = (1u << Chip8Lockstep::LANES) - 1;
+
+// -- one byte per lane, 16 lanes --
+#if defined(__SSE2__)
+typedef __m128i Lane8;
+
+inline Lane8 load8(const unsigned char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+inline void store8(unsigned char *p, Lane8 v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+inline Lane8 splat8(unsigned char b) { return _mm_set1_epi8(static_cast<char>(b)); }
+inline Lane8 add8(Lane8 a, Lane8 b) { return _mm_add_epi8(a, b); }
+inline Lane8 sub8(Lane8 a, Lane8 b) { return _mm_sub_epi8(a, b); }
+inline Lane8 subs8(Lane8 a, Lane8 b) { return _mm_subs_epu8(a, b); }
+inline Lane8 and8(Lane8 a, Lane8 b) { return _mm_and_si128(a, b); }
+inline Lane8 andnot8(Lane8 a, Lane8 b) { return _mm_andnot_si128(a, b); }
+inline Lane8 or8(Lane8 a, Lane8 b) { return _mm_or_si128(a, b); }
+inline Lane8 xor8(Lane8 a, Lane8 b) { return _mm_xor_si128(a, b); }
+inline Lane8 eq8(Lane8 a, Lane8 b) { return _mm_cmpeq_epi8(a, b); }
+inline Lane8 min8(Lane8 a, Lane8 b) { return _mm_min_epu8(a, b); }
+inline Lane8 max8(Lane8 a, Lane8 b) { return _mm_max_epu8(a, b); }
+inline Lane8 shr1(Lane8 a) { return _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F)); }
+inline unsigned int mask8(Lane8 a) { return static_cast<unsigned int>(_mm_movemask_epi8(a)); }
+#else
+struct Lane8 { unsigned char b[16]; };
+
+#define LANE8_MAP(expr)                                  \
+    Lane8 r;                                             \
+    for (int l = 0; l < 16; ++l)                         \
+        r.b[l] = static_cast<unsigned char>(expr);       \
+    return r;
+
+inline Lane8 load8(const unsigned char *p) { Lane8 r; memcpy(r.b, p, 16); return r; }
+inline void store8(unsigned char *p, Lane8 v) { memcpy(p, v.b, 16); }
+inline Lane8 splat8(unsigned char b) { LANE8_MAP(b) }
+inline Lane8 add8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] + b.b[l]) }
+inline Lane8 sub8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] - b.b[l]) }
+inline Lane8 subs8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] > b.b[l] ? a.b[l] - b.b[l] : 0) }
+inline Lane8 and8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] & b.b[l]) }
+inline Lane8 andnot8(Lane8 a, Lane8 b) { LANE8_MAP(~a.b[l] & b.b[l]) }
+inline Lane8 or8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] | b.b[l]) }
+inline Lane8 xor8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] ^ b.b[l]) }
+inline Lane8 eq8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] == b.b[l] ? 0xFF : 0) }
+inline Lane8 min8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] < b.b[l] ? a.b[l] : b.b[l]) }
+inline Lane8 max8(Lane8 a, Lane8 b) { LANE8_MAP(a.b[l] > b.b[l] ? a.b[l] : b.b[l]) }
+inline Lane8 shr1(Lane8 a) { LANE8_MAP(a.b[l] >> 1) }
+inline unsigned int mask8(Lane8 a)
+{
+    unsigned int m = 0;
+    for (int l = 0; l < 16; ++l)
+        if (a.b[l] & 0x80) m |= 1u << l;
+    return m;
+}
+#endif
+
+// -- 16-bit index register across all lanes --
+
+// I = value
+inline void setI16(unsigned short *I, unsigned short value)
+{
+#if defined(__AVX2__)
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(I), _mm256_set1_epi16(static_cast<short>(value)));
+#elif defined(__SSE2__)
+    const __m128i v = _mm_set1_epi16(static_cast<short>(value));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(I), v);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(I + 8), v);
+#else
+    for (int l = 0; l < 16; ++l) I[l] = value;
+#endif
+}
+
+// I = I * keep + V * mul, covers FX1E (keep 1, mul 1) and FX29 (keep 0, mul 5)
+inline void updateI16(unsigned short *I, const unsigned char *V, short keep, short mul)
+{
+#if defined(__AVX2__)
+    const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(V)));
+    const __m256i i = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(I));
+    const __m256i r = _mm256_add_epi16(_mm256_mullo_epi16(i, _mm256_set1_epi16(keep)),
+                                       _mm256_mullo_epi16(v, _mm256_set1_epi16(mul)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(I), r);
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(V));
+    const __m128i half[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+    for (int h = 0; h < 2; ++h)
+    {
+        __m128i *dst = reinterpret_cast<__m128i *>(I + 8 * h);
+        const __m128i r = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128(dst), _mm_set1_epi16(keep)),
+                                        _mm_mullo_epi16(half[h], _mm_set1_epi16(mul)));
+        _mm_storeu_si128(dst, r);
+    }
+#else
+    for (int l = 0; l < 16; ++l) I[l] = I[l] * keep + V[l] * mul;
+#endif
+}
+
+// -- xorshift32 per lane, same sequence as Chip8::nextRandom --
+inline void nextRandom8(unsigned int *rng, unsigned char *out)
+{
+#if defined(__AVX2__)
+    for (int h = 0; h < 2; ++h)
+    {
+        __m256i *p = reinterpret_cast<__m256i *>(rng + 8 * h);
+        __m256i x = _mm256_loadu_si256(p);
+        x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+        x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+        _mm256_storeu_si256(p, x);
+    }
+#elif defined(__SSE2__)
+    for (int q = 0; q < 4; ++q)
+    {
+        __m128i *p = reinterpret_cast<__m128i *>(rng + 4 * q);
+        __m128i x = _mm_loadu_si128(p);
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+        _mm_storeu_si128(p, x);
+    }
+#endif
+
+#if defined(__SSE2__)
+    // narrow the low bytes of the 16 states down to one vector
+    const __m128i low = _mm_set1_epi32(0xFF);
+    __m128i q[4];
+    for (int i = 0; i < 4; ++i)
+        q[i] = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rng + 4 * i)), low);
+    const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+#else
+    for (int l = 0; l < 16; ++l)
+    {
+        rng[l] ^= rng[l] << 13;
+        rng[l] ^= rng[l] >> 17;
+        rng[l] ^= rng[l] << 5;
+        out[l] = rng[l] & 0xFF;
+    }
+#endif
+}
+
+// XOR one sprite byte per lane into the width (up to 8) pixels starting at start, collisions are or-ed into hit
+inline Lane8 drawRow(unsigned char (*gfx)[Chip8Lockstep::LANES], int start, int width, Lane8 sprite, Lane8 hit)
+{
+    const Lane8 one = splat8(1);
+    int k = 0;
+
+#if defined(__AVX2__)
+    // two pixels (32 bytes of SoA display) per iteration
+    const __m256i sprite2 = _mm256_broadcastsi128_si256(sprite);
+    const __m256i one2 = _mm256_set1_epi8(1);
+    __m256i hit2 = _mm256_setzero_si256();
+    for (; k + 1 < width; k += 2)
+    {
+        const __m256i bit = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi8(static_cast<char>(0x80 >> k))),
+                                                     _mm_set1_epi8(static_cast<char>(0x80 >> (k + 1))), 1);
+        const __m256i on = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(sprite2, bit), bit), one2);
+        __m256i *px = reinterpret_cast<__m256i *>(gfx[start + k]);
+        const __m256i old = _mm256_loadu_si256(px);
+        hit2 = _mm256_or_si256(hit2, _mm256_and_si256(old, on));
+        _mm256_storeu_si256(px, _mm256_xor_si256(old, on));
+    }
+    hit = or8(hit, or8(_mm256_castsi256_si128(hit2), _mm256_extracti128_si256(hit2, 1)));
+#endif
+
+    for (; k < width; ++k)
+    {
+        const Lane8 bit = splat8(0x80 >> k);
+        const Lane8 on = and8(eq8(and8(sprite, bit), bit), one);
+        const Lane8 old = load8(gfx[start + k]);
+        hit = or8(hit, and8(old, on));
+        store8(gfx[start + k], xor8(old, on));
+    }
+    return hit;
+}
+
+// timer set to start on setTick, as read on tick
+inline unsigned char timerValue(unsigned char start, unsigned long long setTick, unsigned long long tick)
+{
+    return (tick - setTick < start) ? static_cast<unsigned char>(start - (tick - setTick)) : 0;
+}
+
+} // namespace
+
+// iterate the lanes of a mask, lowest first
+#define FOR_EACH_LANE(lane, mask) \
+    for (unsigned int m_ = (mask), lane = 0; m_ && ((lane = __builtin_ctz(m_)), true); m_ &= m_ - 1)
+
+Chip8Lockstep::Chip8Lockstep()
+{
+    initialize();
+}
+
+void Chip8Lockstep::initialize()
+{
+    cycles = 0;
+    Chip8State state;
+    for (int lane = 0; lane < LANES; ++lane)
+    {
+        scalar[lane].initialize();
+        scalar[lane].saveState(state);
+        scatterLane(lane, state);
+    }
+
+    groupPC = 0x200;
+    groupMask = ALL_LANES;
+    vectorCycles = 0;
+    scalarCycles = 0;
+}
+
+// Reset every lane and load the same game into all of them
+bool Chip8Lockstep::loadGame(const char *filename)
+{
+    initialize();
+
+    if (!scalar[0].loadGame(filename))
+    {
+        return false;
+    }
+
+    const unsigned char *rom = scalar[0].getMemory();
+    for (int addr = 0; addr < 4096; ++addr)
+    {
+        memset(memory[addr], rom[addr], LANES);
+    }
+    return true;
+}
+
+void Chip8Lockstep::emulateCycle()
+{
+    unsigned int stepped = 0;
+
+    // lanes split off here count this cycle on their own interpreter
+    const unsigned short opcode = groupMask ? fetchGroup() : 0;
+    ++cycles; // before executing, as Chip8::emulateCycle counts
+
+    if (groupMask)
+    {
+        stepped = groupMask;
+        if (stepGroup(opcode))
+        {
+            splitDiverged();
+        }
+        ++vectorCycles;
+    }
+
+    // lanes off the group run on their own interpreter
+    FOR_EACH_LANE(lane, ALL_LANES & ~stepped)
+    {
+        scalar[lane].emulateCycle();
+        ++scalarCycles;
+    }
+
+    mergeScalar();
+}
+
+void Chip8Lockstep::run(unsigned long cycles)
+{
+    for (unsigned long i = 0; i < cycles; ++i)
+    {
+        emulateCycle();
+    }
+}
+
+void Chip8Lockstep::setKey(int lane, int key, int value)
+{
+    if (groupMask & (1u << lane))
+    {
+        Chip8Lockstep::key[key & 0xF][lane] = value;
+    }
+    else
+    {
+        scalar[lane].setKey(key, value);
+    }
+}
+
+void Chip8Lockstep::seedLane(int lane, unsigned int seed)
+{
+    if (groupMask & (1u << lane))
+    {
+        rng[lane] = seed ? seed : 0x9E3779B9u; // same zero guard as Chip8::seedRandom
+    }
+    else
+    {
+        scalar[lane].seedRandom(seed);
+    }
+}
+
+void Chip8Lockstep::getLaneState(int lane, Chip8State &state) const
+{
+    if (groupMask & (1u << lane))
+    {
+        gatherLane(lane, groupPC, state);
+    }
+    else
+    {
+        scalar[lane].saveState(state);
+    }
+}
+
+unsigned short Chip8Lockstep::fetchGroup()
+{
+    const unsigned short addr = groupPC & 0x0FFF;
+    const unsigned short addr2 = (groupPC + 1) & 0x0FFF;
+    const int lead = firstLane();
+
+    const unsigned char hi = memory[addr][lead];
+    const unsigned char lo = memory[addr2][lead];
+
+    // self modifying code can leave lanes with different instructions at the same PC
+    const unsigned int same = mask8(eq8(load8(memory[addr]), splat8(hi))) &
+                              mask8(eq8(load8(memory[addr2]), splat8(lo)));
+
+    FOR_EACH_LANE(lane, groupMask & ~same)
+    {
+        splitLane(lane, groupPC);
+    }
+
+    return hi << 8 | lo;
+}
+
+bool Chip8Lockstep::stepGroup(unsigned short opcode)
+{
+    const int x = (opcode & 0x0F00) >> 8;
+    const int y = (opcode & 0x00F0) >> 4;
+    const unsigned char nn = opcode & 0x00FF;
+    const unsigned short nnn = opcode & 0x0FFF;
+    const Lane8 one = splat8(1);
+
+    unsigned short next = groupPC + 2; // next PC when every lane agrees
+    unsigned int skip = 0;             // lanes that skip the next instruction
+    bool perLane = false;              // pc[] holds the next PC of each lane
+
+    switch (opcode & 0xF000)
+    {
+    case 0x0000:
+        switch (opcode & 0x00FF)
+        {
+        case 0x00E0: // Clear the display
+            memset(gfx, 0, sizeof(gfx));
+            break;
+        case 0x00EE: // Return from subroutine
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                sp[lane]--;
+                pc[lane] = stack[sp[lane] & 0xF][lane] + 2;
+            }
+            perLane = true;
+            break;
+        default: // machine code routine, the interpreter stalls here
+            next = groupPC;
+            break;
+        }
+        break;
+    case 0x1000: // 1NNN: Jump to address NNN
+        next = nnn;
+        break;
+    case 0x2000: // 2NNN: Call subroutine at NNN
+        FOR_EACH_LANE(lane, groupMask)
+        {
+            stack[sp[lane] & 0xF][lane] = groupPC;
+            sp[lane]++;
+        }
+        next = nnn;
+        break;
+    case 0x3000: // 3XNN: Skip if VX equals NN
+        skip = mask8(eq8(load8(V[x]), splat8(nn)));
+        break;
+    case 0x4000: // 4XNN: Skip if VX does not equal NN
+        skip = ~mask8(eq8(load8(V[x]), splat8(nn)));
+        break;
+    case 0x5000: // 5XY0: Skip if VX equals VY
+        skip = mask8(eq8(load8(V[x]), load8(V[y])));
+        break;
+    case 0x6000: // 6XNN: Set VX to NN
+        store8(V[x], splat8(nn));
+        break;
+    case 0x7000: // 7XNN: Add NN to VX, no carry
+        store8(V[x], add8(load8(V[x]), splat8(nn)));
+        break;
+    case 0x8000:
+    {
+        const Lane8 vx = load8(V[x]);
+        const Lane8 vy = load8(V[y]);
+        switch (opcode & 0x000F)
+        {
+        case 0x0000: // 8XY0: VX = VY
+            store8(V[x], vy);
+            break;
+        case 0x0001: // 8XY1: VX |= VY
+            store8(V[x], or8(vx, vy));
+            break;
+        case 0x0002: // 8XY2: VX &= VY
+            store8(V[x], and8(vx, vy));
+            break;
+        case 0x0003: // 8XY3: VX ^= VY
+            store8(V[x], xor8(vx, vy));
+            break;
+        case 0x0004: // 8XY4: VX += VY, VF = carry
+        {
+            // the sum wrapped if it came out below VX
+            const Lane8 sum = add8(vx, vy);
+            const Lane8 carry = andnot8(eq8(sum, vx), eq8(min8(sum, vx), sum));
+            store8(V[x], sum);
+            store8(V[0xF], and8(carry, one));
+            break;
+        }
+        case 0x0005: // 8XY5: VX -= VY, VF = no borrow
+        {
+            const Lane8 noBorrow = eq8(max8(vx, vy), vx);
+            store8(V[x], sub8(vx, vy));
+            store8(V[0xF], and8(noBorrow, one));
+            break;
+        }
+        case 0x0006: // 8XY6: VF = LSB of VX, VX >>= 1
+            store8(V[0xF], and8(vx, one));
+            store8(V[x], shr1(load8(V[x])));
+            break;
+        case 0x0007: // 8XY7: VX = VY - VX, VF = no borrow
+        {
+            const Lane8 noBorrow = eq8(max8(vy, vx), vy);
+            store8(V[x], sub8(vy, vx));
+            store8(V[0xF], and8(noBorrow, one));
+            break;
+        }
+        case 0x000E: // 8XYE: VF = MSB of VX, VX <<= 1
+        {
+            const Lane8 msb = splat8(0x80);
+            store8(V[0xF], and8(eq8(and8(vx, msb), msb), one));
+            const Lane8 shifted = load8(V[x]);
+            store8(V[x], add8(shifted, shifted));
+            break;
+        }
+        default: // unknown opcode, the interpreter stalls here
+            next = groupPC;
+            break;
+        }
+        break;
+    }
+    case 0x9000: // 9XY0: Skip if VX does not equal VY
+        skip = ~mask8(eq8(load8(V[x]), load8(V[y])));
+        break;
+    case 0xA000: // ANNN: I = NNN
+        setI16(I, nnn);
+        break;
+    case 0xB000: // BNNN: Jump to NNN + V0
+        FOR_EACH_LANE(lane, groupMask)
+        {
+            pc[lane] = nnn + V[0][lane];
+        }
+        perLane = true;
+        break;
+    case 0xC000: // CXNN: VX = random & NN
+    {
+        alignas(16) unsigned char rnd[LANES];
+        nextRandom8(rng, rnd);
+        store8(V[x], and8(load8(rnd), splat8(nn)));
+        break;
+    }
+    case 0xD000: // DXYN: Draw sprite
+        drawSprite(x, y, opcode & 0x000F);
+        break;
+    case 0xE000:
+        switch (nn)
+        {
+        case 0x009E: // EX9E: Skip if the key in VX is pressed
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                if (key[V[x][lane] & 0xF][lane] != 0) skip |= 1u << lane;
+            }
+            break;
+        case 0x00A1: // EXA1: Skip if the key in VX is not pressed
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                if (key[V[x][lane] & 0xF][lane] == 0) skip |= 1u << lane;
+            }
+            break;
+        default:
+            next = groupPC;
+            break;
+        }
+        break;
+    case 0xF000:
+        switch (nn)
+        {
+        case 0x0007: // FX07: VX = delay timer
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                V[x][lane] = timerValue(delayStart[lane], delaySetTick[lane], ticks());
+            }
+            break;
+        case 0x000A: // FX0A: Wait for a key press, store it in VX
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                pc[lane] = groupPC;
+                for (int k = 0; k < 16; ++k)
+                {
+                    if (key[k][lane] != 0)
+                    {
+                        V[x][lane] = k;
+                        pc[lane] = groupPC + 2;
+                        break;
+                    }
+                }
+            }
+            perLane = true;
+            break;
+        case 0x0015: // FX15: delay timer = VX
+            store8(delayStart, load8(V[x]));
+            FOR_EACH_LANE(lane, groupMask) delaySetTick[lane] = ticks();
+            break;
+        case 0x0018: // FX18: sound timer = VX
+            store8(soundStart, load8(V[x]));
+            FOR_EACH_LANE(lane, groupMask) soundSetTick[lane] = ticks();
+            break;
+        case 0x001E: // FX1E: I += VX
+            updateI16(I, V[x], 1, 1);
+            break;
+        case 0x0029: // FX29: I = font sprite for VX
+            updateI16(I, V[x], 0, 5);
+            break;
+        case 0x0033: // FX33: BCD of VX at I
+            FOR_EACH_LANE(lane, groupMask)
+            {
+                const unsigned short addr = I[lane];
+                const unsigned char value = V[x][lane];
+                memory[addr & 0x0FFF][lane] = value / 100;
+                memory[(addr + 1) & 0x0FFF][lane] = (value / 10) % 10;
+                memory[(addr + 2) & 0x0FFF][lane] = value % 10;
+            }
+            break;
+        case 0x0055: // FX55: Store V0..VX at I
+        {
+            unsigned short base;
+            if (uniformI(base))
+            {
+                for (int i = 0; i <= x; ++i)
+                    store8(memory[(base + i) & 0x0FFF], load8(V[i]));
+            }
+            else
+            {
+                FOR_EACH_LANE(lane, groupMask)
+                {
+                    for (int i = 0; i <= x; ++i)
+                        memory[(I[lane] + i) & 0x0FFF][lane] = V[i][lane];
+                }
+            }
+            break;
+        }
+        case 0x0065: // FX65: Load V0..VX from I
+        {
+            unsigned short base;
+            if (uniformI(base))
+            {
+                for (int i = 0; i <= x; ++i)
+                    store8(V[i], load8(memory[(base + i) & 0x0FFF]));
+            }
+            else
+            {
+                FOR_EACH_LANE(lane, groupMask)
+                {
+                    for (int i = 0; i <= x; ++i)
+                        V[i][lane] = memory[(I[lane] + i) & 0x0FFF][lane];
+                }
+            }
+            break;
+        }
+        default:
+            next = groupPC;
+            break;
+        }
+        break;
+    }
+
+    // Work out where the group goes next
+    if (perLane)
+    {
+        const unsigned short lead = pc[firstLane()];
+        FOR_EACH_LANE(lane, groupMask)
+        {
+            if (pc[lane] != lead) return true;
+        }
+        groupPC = lead;
+        return false;
+    }
+
+    skip &= groupMask;
+    if (skip == 0)
+    {
+        groupPC = next;
+        return false;
+    }
+    if (skip == groupMask)
+    {
+        groupPC += 4;
+        return false;
+    }
+
+    FOR_EACH_LANE(lane, groupMask)
+    {
+        pc[lane] = groupPC + ((skip & (1u << lane)) ? 4 : 2);
+    }
+    return true;
+}
+
+void Chip8Lockstep::drawSprite(int x, int y, int n)
+{
+    // the position wraps onto the screen, past the right and bottom edges is clipped
+    const int lead = firstLane();
+    const unsigned char vx = V[x][lead];
+    const unsigned char vy = V[y][lead];
+    const unsigned int sameXY = mask8(eq8(load8(V[x]), splat8(vx))) & mask8(eq8(load8(V[y]), splat8(vy)));
+    unsigned short base;
+
+    if ((sameXY & groupMask) == groupMask && uniformI(base))
+    {
+        // same position and sprite address everywhere, draw the rows for all lanes at once
+        const int px = vx & 63, py = vy & 31;
+        const int width = px > 56 ? 64 - px : 8;
+        Lane8 hit = splat8(0);
+        for (int row = 0; row < n && py + row < 32; ++row)
+        {
+            hit = drawRow(gfx, px + (py + row) * 64, width, load8(memory[(base + row) & 0x0FFF]), hit);
+        }
+        store8(V[0xF], hit);
+        return;
+    }
+
+    FOR_EACH_LANE(lane, groupMask)
+    {
+        const int lx = V[x][lane] & 63;
+        const int ly = V[y][lane] & 31;
+        unsigned char hit = 0;
+        for (int row = 0; row < n && ly + row < 32; ++row)
+        {
+            const unsigned char sprite = memory[(I[lane] + row) & 0x0FFF][lane];
+            for (int k = 0; k < 8 && lx + k < 64; ++k)
+            {
+                const int idx = lx + k + (ly + row) * 64;
+                if (!(sprite & (0x80 >> k))) continue;
+                hit |= gfx[idx][lane];
+                gfx[idx][lane] ^= 1;
+            }
+        }
+        V[0xF][lane] = hit;
+    }
+}
+
+void Chip8Lockstep::splitLane(int lane, unsigned short lanePC)
+{
+    Chip8State state;
+    gatherLane(lane, lanePC, state);
+    scalar[lane].loadState(state);
+    groupMask &= ~(1u << lane);
+}
+
+// keep the PC most lanes agree on, split off everyone else
+void Chip8Lockstep::splitDiverged()
+{
+    unsigned short leader = groupPC;
+    int best = 0;
+    FOR_EACH_LANE(a, groupMask)
+    {
+        int count = 0;
+        FOR_EACH_LANE(b, groupMask)
+        {
+            count += pc[a] == pc[b];
+        }
+        if (count > best)
+        {
+            best = count;
+            leader = pc[a];
+        }
+    }
+
+    FOR_EACH_LANE(lane, groupMask)
+    {
+        if (pc[lane] != leader) splitLane(lane, pc[lane]);
+    }
+    groupPC = leader;
+}
+
+// bring scalar lanes back once their PC lines up with the group again
+void Chip8Lockstep::mergeScalar()
+{
+    const unsigned int outside = ALL_LANES & ~groupMask;
+    if (!outside) return;
+
+    if (!groupMask)
+    {
+        // everyone diverged, regroup around the lowest lane
+        groupPC = scalar[__builtin_ctz(outside)].getPC();
+    }
+
+    Chip8State state;
+    FOR_EACH_LANE(lane, outside)
+    {
+        if (scalar[lane].getPC() != groupPC) continue;
+        scalar[lane].saveState(state);
+        scatterLane(lane, state);
+        groupMask |= 1u << lane;
+    }
+}
+
+void Chip8Lockstep::gatherLane(int lane, unsigned short lanePC, Chip8State &state) const
+{
+    state.memorySize = 4096;
+    for (int addr = 0; addr < 4096; ++addr) state.memory[addr] = memory[addr][lane];
+    for (int p = 0; p < 64 * 32; ++p) state.gfx[p] = gfx[p][lane];
+    for (int r = 0; r < 16; ++r)
+    {
+        state.V[r] = V[r][lane];
+        state.key[r] = key[r][lane];
+        state.stack[r] = stack[r][lane];
+    }
+    state.I = I[lane];
+    state.pc = lanePC;
+    state.sp = sp[lane];
+    state.delay_timer = timerValue(delayStart[lane], delaySetTick[lane], ticks());
+    state.sound_timer = timerValue(soundStart[lane], soundSetTick[lane], ticks());
+    state.rngState = rng[lane];
+    state.cycles = cycles;
+
+    // CHIP-8 only, a 4K state and the XO-CHIP state at its reset values
+    state.planes = 1;
+    state.pitch = 64;
+    memset(state.pattern, 0, sizeof(state.pattern));
+    state.patternLoaded = false;
+}
+
+void Chip8Lockstep::scatterLane(int lane, const Chip8State &state)
+{
+    for (int addr = 0; addr < 4096; ++addr) memory[addr][lane] = state.memory[addr];
+    for (int p = 0; p < 64 * 32; ++p) gfx[p][lane] = state.gfx[p];
+    for (int r = 0; r < 16; ++r)
+    {
+        V[r][lane] = state.V[r];
+        key[r][lane] = state.key[r];
+        stack[r][lane] = state.stack[r];
+    }
+    I[lane] = state.I;
+    sp[lane] = state.sp;
+    // scalar lanes ran the same number of cycles, their timers restart from now
+    delayStart[lane] = state.delay_timer;
+    soundStart[lane] = state.sound_timer;
+    delaySetTick[lane] = soundSetTick[lane] = ticks();
+    rng[lane] = state.rngState;
+}
+
+bool Chip8Lockstep::uniformI(unsigned short &value) const
+{
+    value = I[firstLane()];
+    FOR_EACH_LANE(lane, groupMask)
+    {
+        if (I[lane] != value) return false;
+    }
+    return true;
+}
+
+int Chip8Lockstep::firstLane() const
+{
+    return __builtin_ctz(groupMask);
+}
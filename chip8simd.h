@@ -0,0 +1,102 @@
+#ifndef CHIP8SIMD_H
+#define CHIP8SIMD_H
+
+#include "chip8.h"
+
+/*
+ * Lockstep interpreter for running many instances of the same ROM at once.
+ *
+ * All lanes keep their state in SoA form (element [n][lane]) so one host
+ * instruction updates a register, timer or display pixel for every lane.
+ * Lanes step together while they agree on the PC. When a branch, skip or
+ * return sends a lane somewhere else it is split off into its own scalar
+ * Chip8 and merged back into the group once its PC lines up again.
+ *
+ * Plain CHIP-8 with the default quirks only, no XO-CHIP.
+ *
+ * Build with SIMD_FLAGS=-mavx2 for the AVX2 paths, SSE2 is used otherwise.
+ */
+class Chip8Lockstep
+{
+public:
+    static const int LANES = 16;
+
+    // Constructor
+    Chip8Lockstep();
+
+    // Reset every lane and regroup them
+    void initialize();
+
+    // Load the same game into every lane
+    bool loadGame(const char *filename);
+
+    // Execute one instruction on every lane
+    void emulateCycle();
+
+    // Execute several instructions on every lane, the timers follow the
+    // cycle count at Chip8::DEFAULT_CLOCK_RATE like the scalar interpreter
+    void run(unsigned long cycles);
+
+    // Per lane input and random seed
+    void setKey(int lane, int key, int value);
+    void seedLane(int lane, unsigned int seed);
+
+    // Copy a single lane out as a regular machine state
+    void getLaneState(int lane, Chip8State &state) const;
+
+    // Lanes currently stepping together in the vector group
+    unsigned int getGroupMask() const { return groupMask; }
+
+    // How many cycles ran vectorized and how many lane-cycles ran scalar
+    unsigned long getVectorCycles() const { return vectorCycles; }
+    unsigned long getScalarCycles() const { return scalarCycles; }
+
+private:
+    // -- SoA machine state, [n][lane] --
+    // only lanes in groupMask hold live data, the others live in scalar[]
+    alignas(32) unsigned char memory[4096][LANES];
+    alignas(32) unsigned char gfx[64 * 32][LANES];
+    alignas(32) unsigned char V[16][LANES];
+    alignas(32) unsigned char delayStart[LANES];  // timers as set, see Chip8
+    alignas(32) unsigned char soundStart[LANES];
+    unsigned long long delaySetTick[LANES];
+    unsigned long long soundSetTick[LANES];
+    alignas(32) unsigned char key[16][LANES];
+    alignas(32) unsigned short I[LANES];
+    alignas(32) unsigned short pc[LANES]; // per lane targets, only filled when lanes diverge
+    alignas(32) unsigned short stack[16][LANES];
+    alignas(32) unsigned short sp[LANES];
+    alignas(32) unsigned int rng[LANES];
+
+    unsigned short groupPC = 0x200; // PC shared by every lane in the group
+    unsigned int groupMask = 0;
+    unsigned long long cycles = 0;  // the same for every lane, scalar ones included
+
+    unsigned long long ticks() const { return cycles * 60 / Chip8::DEFAULT_CLOCK_RATE; }
+
+    // Diverged lanes run on their own interpreter until they line up again
+    Chip8 scalar[LANES];
+
+    unsigned long vectorCycles = 0;
+    unsigned long scalarCycles = 0;
+
+    // fetch the opcode at groupPC, lanes holding different code there are split off
+    unsigned short fetchGroup();
+
+    // execute one opcode on the group, returns true if the lanes disagree on the next PC
+    bool stepGroup(unsigned short opcode);
+    void drawSprite(int x, int y, int n);
+
+    // move lanes between the group and their scalar interpreters
+    void splitLane(int lane, unsigned short lanePC);
+    void splitDiverged();
+    void mergeScalar();
+
+    void gatherLane(int lane, unsigned short lanePC, Chip8State &state) const;
+    void scatterLane(int lane, const Chip8State &state);
+
+    bool uniformI(unsigned short &value) const;
+    int firstLane() const;
+};
+
+#endif // CHIP8SIMD_H
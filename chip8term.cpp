@@ -0,0 +1,256 @@
+#include "chip8term.h"
+#include "chip8trace.h"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <unistd.h>
+
+/**
+ * Terminal display - half block cells, differential ANSI output, raw stdin keys
+ */
+
+namespace
+{
+
+// by cell value, bit 0 = top pixel, bit 1 = bottom pixel
+const char *const GLYPHS[4] = {" ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88"}; // ▀ ▄ █
+const int GLYPH_BYTES[4] = {1, 3, 3, 3};
+
+// index = CHIP-8 key, the same layout as the SDL window
+const char KEYS[] = "x123qweasdzc4rfv";
+
+const char STATUS[] = "ESC restart  Backspace rewind  ^L redraw  ^C quit";
+
+} // namespace
+
+Chip8Terminal::Chip8Terminal()
+{
+    if (!isatty(STDOUT_FILENO))
+    {
+        std::cerr << "--term needs stdout to be a terminal\n";
+        exit(1);
+    }
+
+    // raw keys, a byte at a time, no echo, ^C arrives as a key
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &savedInput) == 0)
+    {
+        termios raw = savedInput;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_iflag &= ~(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+        raw.c_cc[VMIN] = 0; // read never waits
+        raw.c_cc[VTIME] = 0;
+        rawInput = tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == 0;
+    }
+
+    // alternate screen, hidden cursor, both undone by cleanUp
+    out.reserve(ROWS * COLS * 12 + 256); // every cell with a cursor move, never grows
+    out += "\x1b[?1049h\x1b[?25l";
+    active = true;
+    repaint();
+    flush();
+}
+
+Chip8Terminal::~Chip8Terminal()
+{
+    cleanUp();
+}
+
+void Chip8Terminal::repaint()
+{
+    // a cleared screen is all blank cells, only lit ones get sent
+    memset(cells, 0, sizeof(cells));
+    out += "\x1b[2J";
+    char status[96];
+    snprintf(status, sizeof(status), "\x1b[%d;1H%s", ROWS + 2, STATUS);
+    out += status;
+    cursorRow = cursorCol = -1;
+    pending = true;
+}
+
+// Shortest way from where the last glyph left the cursor
+void Chip8Terminal::moveTo(int row, int col)
+{
+    if (row == cursorRow && col == cursorCol) return;
+
+    char move[32];
+    if (row == cursorRow && col > cursorCol)
+    {
+        // step over the gap or write it again, whichever is fewer bytes
+        int rewrite = 0;
+        for (int c = cursorCol; c < col; ++c) rewrite += GLYPH_BYTES[cells[row][c]];
+        const int n = snprintf(move, sizeof(move), "\x1b[%dC", col - cursorCol);
+        if (rewrite <= n)
+        {
+            for (int c = cursorCol; c < col; ++c) out += GLYPHS[cells[row][c]];
+        }
+        else
+        {
+            out += move;
+        }
+    }
+    else if (cursorRow >= 0 && row == cursorRow + 1 && col == 0)
+    {
+        // -1 after a repaint means the cursor is on the status line, not above row 0
+        out += "\r\n";
+    }
+    else
+    {
+        snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, col + 1);
+        out += move;
+    }
+    cursorRow = row;
+    cursorCol = col;
+}
+
+void Chip8Terminal::flush()
+{
+    size_t done = 0;
+    while (done < out.size())
+    {
+        const ssize_t n = write(STDOUT_FILENO, out.data() + done, out.size() - done);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            break; // the terminal went away, nothing left to show it on
+        }
+        done += static_cast<size_t>(n);
+    }
+    out.clear();
+}
+
+bool Chip8Terminal::needsRedraw() const
+{
+    return pending && chip8Now() - lastDraw >= 1000000000LL / MAX_FPS;
+}
+
+void Chip8Terminal::drawGraphics(const Chip8Frame &frame)
+{
+    Chip8TraceSpan span("drawGraphics");
+
+    // a slow link falls behind on bytes, not frames: in between ones are dropped
+    const long long now = chip8Now();
+    if (now - lastDraw < 1000000000LL / MAX_FPS)
+    {
+        pending = true;
+        return;
+    }
+    pending = false;
+    lastDraw = now;
+
+    const unsigned char *gfx = frame.state.gfx;
+    for (int row = 0; row < ROWS; ++row)
+    {
+        const unsigned char *top = gfx + 2 * row * COLS;
+        const unsigned char *bottom = top + COLS;
+        for (int col = 0; col < COLS; ++col)
+        {
+            const unsigned char cell = (top[col] != 0) | (bottom[col] != 0) << 1; // either plane
+            if (cell == cells[row][col]) continue;
+
+            moveTo(row, col);
+            out += GLYPHS[cell];
+            cells[row][col] = cell;
+            ++cursorCol;
+        }
+    }
+
+    if (!out.empty())
+    {
+        Chip8TraceSpan writing("write");
+        flush();
+    }
+
+    // a traced key press reached the terminal, once per press
+    if (frame.keyTrace.drawn != 0 && frame.keyTrace.id != lastTraceId)
+    {
+        latency.record(frame.keyTrace, chip8Now());
+        lastTraceId = frame.keyTrace.id;
+    }
+}
+
+void Chip8Terminal::handleEvents(Chip8Link &link)
+{
+    Chip8TraceSpan span("handleEvents");
+    if (!rawInput) return;
+
+    const long long now = chip8Now();
+    unsigned char buffer[64];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            const unsigned char c = buffer[i];
+            Chip8Input input = {Chip8Input::KEY, 0, true, now};
+
+            if (c == 0x03 || c == 0x04) // ^C, ^D
+            {
+                link.running = false;
+            }
+            else if (c == 0x0C) // ^L
+            {
+                repaint();
+            }
+            else if (c == 0x7F || c == 0x08) // Backspace, held like a key
+            {
+                input.type = Chip8Input::REWIND;
+                if (rewindUntil == 0) link.input.push(input);
+                rewindUntil = now + KEY_HOLD;
+            }
+            else if (c == 0x1B)
+            {
+                // a lone ESC restarts, escape sequences (arrows, F keys, Alt+key) are skipped
+                if (i + 1 == n)
+                {
+                    input.type = Chip8Input::RESTART;
+                    link.input.push(input);
+                }
+                else if (buffer[i + 1] == '[' || buffer[i + 1] == 'O')
+                {
+                    i += 2;
+                    while (i < n && !(buffer[i] >= 0x40 && buffer[i] <= 0x7E)) ++i;
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            else if (const char *key = c ? strchr(KEYS, tolower(c)) : nullptr)
+            {
+                // auto repeat only moves the release further out
+                input.key = static_cast<unsigned char>(key - KEYS);
+                if (keyDownUntil[input.key] == 0) link.input.push(input);
+                keyDownUntil[input.key] = now + KEY_HOLD;
+            }
+        }
+    }
+
+    for (int k = 0; k < 16; ++k)
+    {
+        if (keyDownUntil[k] != 0 && now >= keyDownUntil[k])
+        {
+            Chip8Input input = {Chip8Input::KEY, static_cast<unsigned char>(k), false, now};
+            link.input.push(input);
+            keyDownUntil[k] = 0;
+        }
+    }
+    if (rewindUntil != 0 && now >= rewindUntil)
+    {
+        Chip8Input input = {Chip8Input::REWIND, 0, false, now};
+        link.input.push(input);
+        rewindUntil = 0;
+    }
+}
+
+void Chip8Terminal::cleanUp()
+{
+    if (!active) return;
+    if (rawInput) tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedInput);
+    rawInput = false;
+    out += "\x1b[?25h\x1b[?1049l";
+    flush();
+    active = false;
+}
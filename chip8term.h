@@ -0,0 +1,60 @@
+#ifndef CHIP8TERM_H
+#define CHIP8TERM_H
+
+#include <string>
+#include <termios.h>
+#include "chip8display.h"
+
+/*
+ * The display in a text terminal, for machines without one and SSH sessions.
+ *
+ * Each character cell shows two pixels stacked with the half block glyphs,
+ * so the 64x32 display takes 64x16 cells. Only cells that changed since the
+ * last frame are sent, with the shortest cursor move to reach them, and at
+ * most MAX_FPS frames a second. A frame that only moves a sprite costs a few
+ * dozen bytes.
+ *
+ * Keys come from stdin in raw mode. A terminal sends no key releases, so a
+ * key counts as held until KEY_HOLD after its last character, the auto
+ * repeat keeps a held key down (after one gap at the repeat delay).
+ */
+class Chip8Terminal : public Chip8Display
+{
+public:
+    Chip8Terminal();
+    ~Chip8Terminal();
+
+    void drawGraphics(const Chip8Frame &frame) override;
+    bool needsRedraw() const override;
+    void handleEvents(Chip8Link &link) override;
+    void cleanUp() override;
+    const Chip8LatencyStats &getLatency() const override { return latency; }
+
+private:
+    static const int COLS = 64;
+    static const int ROWS = 16;
+    static const int MAX_FPS = 30;
+    static const long long KEY_HOLD = 150000000; // ns
+
+    unsigned char cells[ROWS][COLS]; // what the terminal shows
+    int cursorRow = -1, cursorCol = -1;
+    std::string out; // one frame's output, written with one call
+
+    long long lastDraw = 0;
+    bool pending = false; // a frame came in before MAX_FPS allowed it
+
+    bool active = false;   // alternate screen is up
+    bool rawInput = false;
+    termios savedInput;
+    long long keyDownUntil[16] = {0}; // 0 = released
+    long long rewindUntil = 0;
+
+    Chip8LatencyStats latency;
+    unsigned long lastTraceId = 0;
+
+    void moveTo(int row, int col);
+    void flush();
+    void repaint();
+};
+
+#endif // CHIP8TERM_H
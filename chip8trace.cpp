@@ -0,0 +1,186 @@
+#include "chip8trace.h"
+#include "chip8alloc.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+/**
+ * Trace recorder - per thread event buffers, JSON only when writing
+ */
+
+namespace
+{
+
+struct Event
+{
+    const char *name;
+    long long start; // ns since the trace started
+    long long end;   // span end, unused for counters
+    double value;    // counter value
+    bool counter;
+};
+
+// events land in fixed blocks that are never moved, a full one gets a new
+// block next to it instead of a vector doubling and copying mid frame
+const size_t CHUNK_EVENTS = 1 << 16;
+
+// about a minute of a busy loop per thread, a long trace drops the rest
+const size_t MAX_EVENTS = 1 << 22;
+
+struct ThreadBuffer
+{
+    std::mutex lock; // only contended while write() copies it
+    std::vector<std::unique_ptr<Event[]> > chunks;
+    size_t count = 0;
+    const char *name = nullptr;
+    int tid = 0;
+    unsigned long dropped = 0;
+};
+
+std::mutex buffersLock;
+std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+thread_local ThreadBuffer *local = nullptr;
+
+ThreadBuffer &threadBuffer()
+{
+    if (local == nullptr)
+    {
+        Chip8AllocCheck::Allow allow; // once per thread
+        std::lock_guard<std::mutex> guard(buffersLock);
+        buffers.emplace_back(new ThreadBuffer());
+        local = buffers.back().get();
+        local->tid = static_cast<int>(buffers.size());
+        local->chunks.reserve(MAX_EVENTS / CHUNK_EVENTS);
+    }
+    return *local;
+}
+
+void record(const Event &event)
+{
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> guard(buffer.lock);
+    if (buffer.count >= MAX_EVENTS)
+    {
+        ++buffer.dropped;
+        return;
+    }
+    if (buffer.count % CHUNK_EVENTS == 0)
+    {
+        Chip8AllocCheck::Allow allow; // once every CHUNK_EVENTS events
+        buffer.chunks.emplace_back(new Event[CHUNK_EVENTS]);
+    }
+    buffer.chunks.back()[buffer.count % CHUNK_EVENTS] = event;
+    ++buffer.count;
+}
+
+} // namespace
+
+bool Chip8Trace::active = false;
+std::string Chip8Trace::path;
+long long Chip8Trace::origin = 0;
+
+bool Chip8Trace::start(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        std::perror(path);
+        return false;
+    }
+    fclose(file);
+
+    Chip8Trace::path = path;
+    origin = chip8Now();
+    active = true;
+    return true;
+}
+
+void Chip8Trace::nameThread(const char *name)
+{
+    if (!active) return;
+    ThreadBuffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> guard(buffer.lock);
+    buffer.name = name;
+}
+
+void Chip8Trace::complete(const char *name, long long start, long long end)
+{
+    if (!active) return;
+    Event event = {name, start - origin, end - origin, 0.0, false};
+    record(event);
+}
+
+void Chip8Trace::counter(const char *name, double value)
+{
+    if (!active) return;
+    const long long now = chip8Now() - origin;
+    Event event = {name, now, now, value, true};
+    record(event);
+}
+
+bool Chip8Trace::write()
+{
+    if (!active) return false;
+    Chip8AllocCheck::Allow allow; // once, after the loops are done
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        std::perror(path.c_str());
+        return false;
+    }
+
+    // timestamps in microseconds, one event per line
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    std::lock_guard<std::mutex> listGuard(buffersLock);
+    std::vector<Event> events;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers)
+    {
+        // copy out, the owner only waits for a memcpy and not for the formatting
+        const char *name;
+        unsigned long dropped;
+        {
+            std::lock_guard<std::mutex> guard(buffer->lock);
+            events.clear();
+            for (size_t done = 0; done < buffer->count; done += CHUNK_EVENTS)
+            {
+                const Event *chunk = buffer->chunks[done / CHUNK_EVENTS].get();
+                events.insert(events.end(), chunk, chunk + std::min(CHUNK_EVENTS, buffer->count - done));
+            }
+            name = buffer->name;
+            dropped = buffer->dropped;
+        }
+
+        if (name)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->tid, name);
+            first = false;
+        }
+        for (const Event &e : events)
+        {
+            if (e.counter)
+            {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}",
+                        first ? "" : ",\n", e.name, e.start / 1000.0, buffer->tid, e.value);
+            }
+            else
+            {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                        first ? "" : ",\n", e.name, e.start / 1000.0, (e.end - e.start) / 1000.0, buffer->tid);
+            }
+            first = false;
+        }
+        if (dropped)
+        {
+            std::cerr << "Trace buffer full, " << dropped << " events dropped\n";
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
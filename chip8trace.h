@@ -0,0 +1,56 @@
+#ifndef CHIP8TRACE_H
+#define CHIP8TRACE_H
+
+#include <string>
+#include "chip8latency.h"
+
+/*
+ * Timeline of the emulator loops as Chrome trace event JSON, open it in
+ * ui.perfetto.dev or chrome://tracing.
+ *
+ * Every thread records into its own buffer, events are plain structs with
+ * a name pointer and two timestamps and only become JSON when the trace is
+ * written, at exit or on demand (F8). While tracing is off a span costs a
+ * branch.
+ */
+class Chip8Trace
+{
+public:
+    // Record from now on, write() saves to path
+    static bool start(const char *path);
+    static bool isActive() { return active; }
+
+    // Label the calling thread in the viewer
+    static void nameThread(const char *name);
+
+    // A span that ran from start to end (chip8Now()), name must outlive the trace
+    static void complete(const char *name, long long start, long long end);
+
+    // Sample of a counter track
+    static void counter(const char *name, double value);
+
+    // Everything recorded so far, recording carries on
+    static bool write();
+
+private:
+    static bool active; // set before the other threads start
+    static std::string path;
+    static long long origin;
+};
+
+// Records the enclosing scope as a span
+class Chip8TraceSpan
+{
+public:
+    explicit Chip8TraceSpan(const char *name) : name(name), start(Chip8Trace::isActive() ? chip8Now() : 0) {}
+    ~Chip8TraceSpan()
+    {
+        if (start) Chip8Trace::complete(name, start, chip8Now());
+    }
+
+private:
+    const char *name;
+    long long start;
+};
+
+#endif // CHIP8TRACE_H
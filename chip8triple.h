@@ -0,0 +1,54 @@
+#ifndef CHIP8TRIPLE_H
+#define CHIP8TRIPLE_H
+
+#include <atomic>
+
+/*
+ * Lock free triple buffer, one producer and one consumer.
+ *
+ * The producer always has a slot to fill and the consumer always has the
+ * latest complete one to read, neither ever waits for the other. Publishing
+ * swaps the filled slot with the middle one, so a slow consumer skips
+ * frames instead of holding the producer back; the sequence numbers show
+ * how many it skipped.
+ */
+template <typename T>
+class Chip8TripleBuffer
+{
+public:
+    // Producer side: fill back(), then publish it
+    T &back() { return slots[backIdx]; }
+
+    void publish()
+    {
+        seqs[backIdx] = ++published;
+        backIdx = middle.exchange(backIdx | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Consumer side: take the latest published slot, false if nothing new
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        frontIdx = middle.exchange(frontIdx, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T &front() const { return slots[frontIdx]; }
+
+    // Publish count of front(), 0 before the first update
+    unsigned long long sequence() const { return seqs[frontIdx]; }
+
+private:
+    static const unsigned int INDEX = 3;
+    static const unsigned int FRESH = 4; // middle holds a slot the consumer hasn't taken
+
+    T slots[3];
+    unsigned long long seqs[3] = {0, 0, 0};
+    unsigned long long published = 0; // producer only
+
+    unsigned int backIdx = 0;  // producer only
+    unsigned int frontIdx = 2; // consumer only
+    std::atomic<unsigned int> middle{1};
+};
+
+#endif // CHIP8TRIPLE_H
@@ -0,0 +1,451 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "chip8.h"
+#include "chip8simd.h"
+#include "chip8native.h"
+#include "logger.h"
+
+/**
+ * chip8verify - differential lockstep verifier
+ *
+ * Runs a ROM through the plain interpreter (Chip8::emulateCycle) and an engine
+ * under test side by side, with the same seeds and the same scripted key
+ * presses, and compares a rolling hash of the whole machine state of every
+ * instance after every instruction or block. The first mismatch stops that
+ * ROM with a diff of the registers, memory and display. With --block the
+ * divergent block is replayed one instruction at a time, everything is
+ * deterministic, so the diff is always at the instruction that went wrong.
+ *
+ * Engines:
+ *   lockstep  Chip8Lockstep, 16 lanes with their own seeds and keys
+ *   native    a chip8c build of the ROM, <rom>.so next to it
+ *
+ * ROMs are spread over threads, the final hash of a ROM that passed is
+ * printed too so runs can be compared between builds.
+ */
+
+namespace
+{
+
+struct Options
+{
+    std::string engine = "lockstep";
+    unsigned long cycles = 200000;
+    unsigned long block = 1;
+    unsigned int seed = 1;
+};
+
+// -- state hash --
+
+inline uint64_t mix(uint64_t h, uint64_t v)
+{
+    h ^= v;
+    h *= 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+}
+
+uint64_t hashBytes(uint64_t h, const unsigned char *p, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        h = mix(h, v);
+    }
+    for (; i < size; ++i) h = mix(h, p[i]);
+    return h;
+}
+
+// Both engines are CHIP-8 only, memory past 4K is never addressed
+const size_t MEMORY = 4096;
+
+// Field by field, the padding in Chip8State is never written
+uint64_t hashState(uint64_t rolling, const Chip8State &s)
+{
+    uint64_t h = hashBytes(rolling, s.memory, MEMORY);
+    h = hashBytes(h, s.gfx, sizeof(s.gfx));
+    h = hashBytes(h, s.V, sizeof(s.V));
+    h = hashBytes(h, s.key, sizeof(s.key));
+    for (int i = 0; i < 16; ++i) h = mix(h, s.stack[i]);
+    h = mix(h, static_cast<uint64_t>(s.I) | static_cast<uint64_t>(s.pc) << 16 | static_cast<uint64_t>(s.sp) << 32 |
+               static_cast<uint64_t>(s.delay_timer) << 48 | static_cast<uint64_t>(s.sound_timer) << 56);
+    h = mix(h, s.rngState);
+    h = mix(h, static_cast<uint64_t>(s.planes) | static_cast<uint64_t>(s.pitch) << 8 | static_cast<uint64_t>(s.patternLoaded) << 16);
+    h = hashBytes(h, s.pattern, sizeof(s.pattern));
+    return mix(h, s.cycles);
+}
+
+// -- engines under test --
+
+class Engine
+{
+public:
+    virtual ~Engine() {}
+    virtual bool load(const char *path) = 0;
+    virtual int instances() const = 0;
+    virtual void seed(int instance, unsigned int seed) = 0;
+    virtual void setKey(int instance, int key, int value) = 0;
+    virtual void run(unsigned long cycles) = 0;
+    virtual void getState(int instance, Chip8State &state) const = 0;
+};
+
+class LockstepEngine : public Engine
+{
+public:
+    // the SoA arrays are 32 byte aligned, more than plain new promises before C++17
+    static void *operator new(size_t size)
+    {
+        void *p;
+        if (posix_memalign(&p, 32, size) != 0) throw std::bad_alloc();
+        return p;
+    }
+    static void operator delete(void *p) { free(p); }
+
+    bool load(const char *path) override { return lockstep.loadGame(path); }
+    int instances() const override { return Chip8Lockstep::LANES; }
+    void seed(int instance, unsigned int seed) override { lockstep.seedLane(instance, seed); }
+    void setKey(int instance, int key, int value) override { lockstep.setKey(instance, key, value); }
+    void run(unsigned long cycles) override { lockstep.run(cycles); }
+    void getState(int instance, Chip8State &state) const override { lockstep.getLaneState(instance, state); }
+
+private:
+    Chip8Lockstep lockstep;
+};
+
+class NativeEngine : public Engine
+{
+public:
+    bool load(const char *path) override
+    {
+        const std::string so = std::string(path) + ".so";
+        if (!native.load(so.c_str())) return false;
+        chip8.initialize();
+        if (!chip8.loadGame(path)) return false;
+        chip8.setNative(&native);
+        return true;
+    }
+    int instances() const override { return 1; }
+    void seed(int, unsigned int seed) override { chip8.seedRandom(seed); }
+    void setKey(int, int key, int value) override { chip8.setKey(key, value); }
+    void run(unsigned long cycles) override { chip8.runCycles(static_cast<int>(cycles)); }
+    void getState(int, Chip8State &state) const override { chip8.saveState(state); }
+
+private:
+    Chip8 chip8;
+    Chip8Native native;
+};
+
+Engine *makeEngine(const std::string &name)
+{
+    if (name == "lockstep") return new LockstepEngine();
+    if (name == "native") return new NativeEngine();
+    return nullptr;
+}
+
+// Key presses and releases at random cycles, one script per instance
+struct KeyScript
+{
+    unsigned int rng;
+    unsigned long next; // cycle of the next event
+    bool down[16];
+
+    void start(unsigned int seed)
+    {
+        rng = seed ? seed : 1;
+        memset(down, 0, sizeof(down));
+        next = 1 + random() % 400;
+    }
+
+    unsigned int random()
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+};
+
+// -- the comparison --
+
+struct Divergence
+{
+    unsigned long cycle = 0; // 0 = none
+    int instance = 0;
+    unsigned short pc = 0;   // instruction before it, only known when stepping singly
+    unsigned short opcode = 0;
+    bool stepped = false;
+    Chip8State reference;
+    Chip8State engine;
+};
+
+// Runs cycles, comparing every block. Fills diverged and returns false on the first mismatch
+bool compare(const char *path, const Options &options, unsigned long block, unsigned long cycles,
+             uint64_t &fingerprint, Divergence &diverged, std::string &error)
+{
+    std::unique_ptr<Engine> engine(makeEngine(options.engine));
+    if (!engine->load(path))
+    {
+        error = options.engine == "native" ? "can't load the ROM or its .so (build it with chip8c)" : "can't load the ROM";
+        return false;
+    }
+
+    const int n = engine->instances();
+    std::unique_ptr<Chip8[]> reference(new Chip8[n]);
+    std::vector<KeyScript> scripts(n);
+    std::vector<uint64_t> refHash(n, 0), engineHash(n, 0);
+    std::vector<unsigned short> lastPC(n, 0x200);
+    for (int i = 0; i < n; ++i)
+    {
+        reference[i].initialize();
+        if (!reference[i].loadGame(path))
+        {
+            error = "can't load the ROM";
+            return false;
+        }
+        const unsigned int seed = options.seed * 0x9E3779B9u + static_cast<unsigned int>(i);
+        reference[i].seedRandom(seed);
+        engine->seed(i, seed);
+        scripts[i].start(seed ^ 0x5BD1E995u);
+    }
+
+    std::unique_ptr<Chip8State> a(new Chip8State()), b(new Chip8State());
+    unsigned long done = 0;
+    while (done < cycles)
+    {
+        unsigned long step = std::min(block - done % block, cycles - done);
+        for (int i = 0; i < n; ++i)
+        {
+            step = std::min(step, scripts[i].next - done);
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            for (unsigned long c = 0; c < step; ++c) reference[i].emulateCycle();
+        }
+        engine->run(step);
+        done += step;
+
+        for (int i = 0; i < n; ++i)
+        {
+            KeyScript &script = scripts[i];
+            if (script.next == done)
+            {
+                const int key = script.random() & 0xF;
+                script.down[key] = !script.down[key];
+                reference[i].setKey(key, script.down[key]);
+                engine->setKey(i, key, script.down[key]);
+                script.next = done + 1 + script.random() % 400;
+            }
+        }
+
+        if (done % block != 0 && done != cycles) continue;
+
+        for (int i = 0; i < n; ++i)
+        {
+            reference[i].saveState(*a);
+            engine->getState(i, *b);
+            refHash[i] = hashState(refHash[i], *a);
+            engineHash[i] = hashState(engineHash[i], *b);
+            if (refHash[i] != engineHash[i])
+            {
+                diverged.cycle = done;
+                diverged.instance = i;
+                diverged.stepped = step == 1;
+                diverged.pc = lastPC[i];
+                const unsigned char *memory = reference[i].getMemory();
+                diverged.opcode = static_cast<unsigned short>(memory[lastPC[i] & 0xFFF] << 8 | memory[(lastPC[i] + 1) & 0xFFF]);
+                diverged.reference = *a;
+                diverged.engine = *b;
+                return false;
+            }
+            lastPC[i] = a->pc;
+        }
+    }
+
+    fingerprint = 0;
+    for (int i = 0; i < n; ++i) fingerprint = mix(fingerprint, refHash[i]);
+    return true;
+}
+
+void appendf(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void appendf(std::string &out, const char *format, ...)
+{
+    char buffer[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    out += buffer;
+}
+
+void describe(const Divergence &d, std::string &out)
+{
+    const Chip8State &r = d.reference;
+    const Chip8State &e = d.engine;
+
+    appendf(out, "  instance %d, cycle %lu", d.instance, d.cycle);
+    if (d.stepped) appendf(out, ", after %04X at %03X", d.opcode, d.pc);
+    out += "\n";
+
+    for (int i = 0; i < 16; ++i)
+    {
+        if (r.V[i] != e.V[i]) appendf(out, "  V%X      ref %02X  engine %02X\n", i, r.V[i], e.V[i]);
+    }
+    if (r.I != e.I) appendf(out, "  I       ref %03X  engine %03X\n", r.I, e.I);
+    if (r.pc != e.pc) appendf(out, "  PC      ref %03X  engine %03X\n", r.pc, e.pc);
+    if (r.sp != e.sp) appendf(out, "  SP      ref %X  engine %X\n", r.sp, e.sp);
+    for (int i = 0; i < 16; ++i)
+    {
+        if (r.stack[i] != e.stack[i]) appendf(out, "  stack %X ref %03X  engine %03X\n", i, r.stack[i], e.stack[i]);
+    }
+    if (r.delay_timer != e.delay_timer) appendf(out, "  DT      ref %02X  engine %02X\n", r.delay_timer, e.delay_timer);
+    if (r.sound_timer != e.sound_timer) appendf(out, "  ST      ref %02X  engine %02X\n", r.sound_timer, e.sound_timer);
+    if (r.rngState != e.rngState) appendf(out, "  RNG     ref %08X  engine %08X\n", r.rngState, e.rngState);
+    if (r.cycles != e.cycles) appendf(out, "  cycles  ref %llu  engine %llu\n", r.cycles, e.cycles);
+    if (memcmp(r.key, e.key, sizeof(r.key))) out += "  keys differ\n";
+
+    // differing memory as runs, the first few bytes of each
+    int runs = 0;
+    for (int addr = 0; addr < static_cast<int>(MEMORY) && runs < 16;)
+    {
+        if (r.memory[addr] == e.memory[addr])
+        {
+            ++addr;
+            continue;
+        }
+        int end = addr;
+        while (end < static_cast<int>(MEMORY) && r.memory[end] != e.memory[end]) ++end;
+        const int shown = std::min(end - addr, 8);
+        appendf(out, "  memory %03X-%03X ref", addr, end - 1);
+        for (int i = 0; i < shown; ++i) appendf(out, " %02X", r.memory[addr + i]);
+        out += shown < end - addr ? " ... engine" : "  engine";
+        for (int i = 0; i < shown; ++i) appendf(out, " %02X", e.memory[addr + i]);
+        out += shown < end - addr ? " ...\n" : "\n";
+        addr = end;
+        ++runs;
+    }
+
+    // differing display rows, + lit only in the engine, - only in the reference
+    for (int y = 0; y < 32; ++y)
+    {
+        const unsigned char *rr = r.gfx + y * 64, *er = e.gfx + y * 64;
+        if (!memcmp(rr, er, 64)) continue;
+        char row[65];
+        for (int x = 0; x < 64; ++x)
+        {
+            row[x] = rr[x] == er[x] ? (rr[x] ? '#' : '.') : (er[x] ? '+' : '-');
+        }
+        row[64] = '\0';
+        appendf(out, "  row %2d  %s\n", y, row);
+    }
+}
+
+// Whole check of one ROM, returns the report line(s)
+bool verifyRom(const char *path, const Options &options, std::string &report)
+{
+    uint64_t fingerprint = 0;
+    std::string error;
+    std::unique_ptr<Divergence> diverged(new Divergence());
+    if (compare(path, options, options.block, options.cycles, fingerprint, *diverged, error))
+    {
+        appendf(report, "%s: ok, %lu cycles, %016llx\n", path, options.cycles, static_cast<unsigned long long>(fingerprint));
+        return true;
+    }
+    if (!error.empty())
+    {
+        appendf(report, "%s: %s\n", path, error.c_str());
+        return false;
+    }
+
+    // replay the block that diverged an instruction at a time
+    if (!diverged->stepped)
+    {
+        const unsigned long end = diverged->cycle;
+        compare(path, options, 1, end, fingerprint, *diverged, error);
+    }
+    appendf(report, "%s: DIVERGED from the interpreter (%s)\n", path, options.engine.c_str());
+    describe(*diverged, report);
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<const char *> roms;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--engine" && i + 1 < argc)
+            options.engine = argv[++i];
+        else if (arg == "--cycles" && i + 1 < argc)
+            options.cycles = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--block" && i + 1 < argc)
+            options.block = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-j" && i + 1 < argc)
+            jobs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else
+            roms.push_back(argv[i]);
+    }
+
+    if (roms.empty())
+    {
+        std::cout << "Usage: ./chip8verify [--engine <lockstep|native>] [--cycles <n>] [--block <n>] [--seed <n>] [-j <threads>] <gamePath>...\n";
+        return 0;
+    }
+    std::unique_ptr<Engine> probe(makeEngine(options.engine));
+    if (!probe)
+    {
+        std::cerr << "Unknown engine, use lockstep or native\n";
+        return 1;
+    }
+    probe.reset();
+
+    // ROMs that diverge hit unknown opcodes, warning on each would serialize the workers on the log
+    Logger::setLevel(CHIP8_LOG_OFF);
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    std::mutex printing;
+    auto worker = [&]()
+    {
+        for (size_t r; (r = next.fetch_add(1)) < roms.size();)
+        {
+            std::string report;
+            if (!verifyRom(roms[r], options, report)) ++failed;
+            std::lock_guard<std::mutex> lock(printing);
+            fputs(report.c_str(), stdout);
+            fflush(stdout);
+        }
+    };
+
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < std::min<size_t>(jobs, roms.size()); ++t) threads.emplace_back(worker);
+    for (size_t t = 0; t < threads.size(); ++t) threads[t].join();
+
+    printf("%zu ROMs, %d failed, %.1fs\n", roms.size(), failed.load(),
+           std::chrono::duration<double>(clock::now() - start).count());
+    return failed ? 1 : 0;
+}
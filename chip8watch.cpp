@@ -0,0 +1,90 @@
+#include "chip8watch.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/**
+ * ROM watch - inotify on the ROM's directory, filtered by name
+ */
+
+Chip8RomWatch::~Chip8RomWatch()
+{
+    close();
+}
+
+bool Chip8RomWatch::open(const char *path)
+{
+    close();
+
+    this->path = path;
+    const char *slash = strrchr(path, '/');
+    const std::string dir = slash ? std::string(path, slash - path + 1) : std::string(".");
+    file = slash ? slash + 1 : path;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        std::perror("inotify_init1");
+        return false;
+    }
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        std::perror(dir.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Chip8RomWatch::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool Chip8RomWatch::changed()
+{
+    if (fd < 0) return false;
+
+    bool hit = false;
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        const ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+        {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) std::perror("inotify read");
+            break;
+        }
+        for (ssize_t pos = 0; pos < n;)
+        {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + pos);
+            if (event->len > 0 && file == event->name) hit = true;
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    return hit;
+}
+
+bool Chip8RomWatch::read(std::vector<unsigned char> &data) const
+{
+    FILE *in = fopen(path.c_str(), "rb");
+    if (in == nullptr)
+    {
+        std::perror(path.c_str());
+        return false;
+    }
+    data.clear();
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    const bool ok = !ferror(in);
+    fclose(in);
+    return ok;
+}
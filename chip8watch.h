@@ -0,0 +1,35 @@
+#ifndef CHIP8WATCH_H
+#define CHIP8WATCH_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Notices when the ROM file is rebuilt, for hot reloading (inotify).
+ *
+ * The directory is watched rather than the file, build tools and editors
+ * often write a new file and rename it over the old one. Only finished
+ * writes count, so a reload never sees a half written ROM.
+ */
+class Chip8RomWatch
+{
+public:
+    ~Chip8RomWatch();
+
+    bool open(const char *path);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+
+    // True if the file was rewritten since the last call, never blocks
+    bool changed();
+
+    // The file as it is now
+    bool read(std::vector<unsigned char> &data) const;
+
+private:
+    int fd = -1;
+    std::string path;
+    std::string file; // name within the watched directory
+};
+
+#endif // CHIP8WATCH_H
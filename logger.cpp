@@ -1,66 +1,99 @@
 #include "logger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 
 /**
- * Logging class - Pretty self explanitory
- * Logs in jsonl format (because im lame and like that format)
- * Will be updated as I go for certain
+ * Logging class - leveled lines in jsonl format
+ * (because im lame and like that format)
  */
 
-Logger::Logger(const char *filename)
+namespace
 {
-    try
-    {
-        logFile.open(filename);
-    }catch(int e){
-        std::cerr << "Cant open log file" << std::endl;
-    }
+
+const char *const LEVEL_NAMES[] = {"trace", "debug", "info", "warn", "off"};
+
+std::mutex &lock()
+{
+    static std::mutex m;
+    return m;
 }
 
-bool Logger::closeLog()
+} // namespace
+
+std::atomic<int> Logger::current(CHIP8_LOG_INFO);
+thread_local int Logger::muted = 0;
+const char *Logger::path = "log.jsonl";
+FILE *Logger::file = nullptr;
+
+bool Logger::setLevel(const char *name)
 {
-    try
+    for (int level = CHIP8_LOG_TRACE; level <= CHIP8_LOG_OFF; ++level)
     {
-        logFile.close();
-        return true;
-    }
-    catch (int e)
-    {
-        std::cerr << "Log file not open" << std::endl;
+        if (strcmp(name, LEVEL_NAMES[level]) == 0)
+        {
+            setLevel(level);
+            return true;
+        }
     }
     return false;
 }
 
+void Logger::setPath(const char *path)
+{
+    Logger::path = path;
+}
 
 /**
- * Try to write sting to file
- * 
- * Format is: <timestamp> <string>
- * 
- * Returns:
- * true on success
- * false on error
+ * Format is: {"time": "<ms>", "level": "<level>", "message": "<text>"}
+ *
+ * Lines go through stdio's buffer, only warnings flush it
  */
-bool Logger::writeLog(const char *string)
+void Logger::write(int level, const char *format, ...)
 {
-    try
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (level >= CHIP8_LOG_WARN) fprintf(stderr, "%s\n", message);
+
+    std::lock_guard<std::mutex> guard(lock());
+    static bool opened = false;
+    if (file == nullptr)
     {
-        if (logFile.is_open())
+        file = fopen(path, opened ? "a" : "w"); // fresh each run, appended after a close
+        if (file == nullptr)
         {
-            
-            std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-            //std::time_t currentTime = std::time(nullptr);
-            logFile << "{\"time\": \"" << std::to_string(ms.count()) << "\", " << string << "}" << std::endl;
-            return true;
-        }
-        else
-        {
-            std::cerr << "Log file not open" << std::endl;
-            return false;
+            fprintf(stderr, "Cant open log file %s\n", path);
+            setLevel(CHIP8_LOG_OFF); // once is enough
+            return;
         }
+        if (!opened) atexit(close);
+        opened = true;
     }
-    catch (int e)
+
+    const long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    fprintf(file, "{\"time\": \"%lld\", \"level\": \"%s\", \"message\": \"", ms, LEVEL_NAMES[level]);
+    for (const char *c = message; *c; ++c)
     {
-        std::cerr << "Error writing to log file" << std::endl;
-        return false;
+        if (*c == '"' || *c == '\\') fputc('\\', file);
+        if (static_cast<unsigned char>(*c) >= 0x20) fputc(*c, file);
     }
-}
\ No newline at end of file
+    fputs("\"}\n", file);
+    if (level >= CHIP8_LOG_WARN) fflush(file);
+}
+
+void Logger::close()
+{
+    std::lock_guard<std::mutex> guard(lock());
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+}
@@ -1,34 +1,84 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <fstream>
-#include <iostream>
-#include <chrono>
-
-
-class Logger{
+#include <atomic>
+#include <cstdio>
+
+/*
+ * Leveled logging to log.jsonl, one JSON object per line.
+ *
+ * LOG_TRACE, LOG_DEBUG, LOG_INFO and LOG_WARN take printf style arguments.
+ * Levels below CHIP8_LOG_MAX_LEVEL are compiled out (release builds stop at
+ * info), levels below the one set at run time cost a compare, and in both
+ * cases the arguments are never evaluated. The file is created by the first
+ * line actually written, so a run that logs nothing leaves nothing behind.
+ * Warnings are echoed to stderr. The level is shared by every thread, a
+ * Logger::Mute silences only the thread that holds it.
+ */
+
+#define CHIP8_LOG_TRACE 0
+#define CHIP8_LOG_DEBUG 1
+#define CHIP8_LOG_INFO 2
+#define CHIP8_LOG_WARN 3
+#define CHIP8_LOG_OFF 4
+
+#ifndef CHIP8_LOG_MAX_LEVEL
+#ifdef NDEBUG
+#define CHIP8_LOG_MAX_LEVEL CHIP8_LOG_INFO
+#else
+#define CHIP8_LOG_MAX_LEVEL CHIP8_LOG_TRACE
+#endif
+#endif
+
+#define CHIP8_LOG(level, ...)                                                   \
+    do                                                                          \
+    {                                                                           \
+        if ((level) >= CHIP8_LOG_MAX_LEVEL && (level) >= Logger::getLevel())    \
+            Logger::write((level), __VA_ARGS__);                                \
+    } while (0)
+
+#define LOG_TRACE(...) CHIP8_LOG(CHIP8_LOG_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) CHIP8_LOG(CHIP8_LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) CHIP8_LOG(CHIP8_LOG_INFO, __VA_ARGS__)
+#define LOG_WARN(...) CHIP8_LOG(CHIP8_LOG_WARN, __VA_ARGS__)
+
+class Logger
+{
+public:
+    // Lines below level are dropped, info unless told otherwise
+    static void setLevel(int level) { current.store(level, std::memory_order_relaxed); }
+    static int getLevel() { return muted > 0 ? CHIP8_LOG_OFF : current.load(std::memory_order_relaxed); }
+
+    // Nothing from this thread is logged while one is in scope, for emulation
+    // that is tried out or thrown away rather than shown
+    class Mute
+    {
     public:
-        // Opens/creates the log file 
-        Logger(const char *filename);
-
-
-        // tries to close the log file
-        bool closeLog();
-
-
-        bool writeLog(const char *string);
-
-
-
-    private:
-
-        const char *filename;
-
-        std::ofstream logFile; //write only file
-
-        bool fileOpen;
-
-
+        Mute() { ++muted; }
+        ~Mute() { --muted; }
+    };
+
+    // trace, debug, info, warn or off, false for anything else
+    static bool setLevel(const char *name);
+
+    // Before the first line, the file is only opened then
+    static void setPath(const char *path);
+
+    // Use the LOG_ macros, they skip the call and its arguments when off
+    static void write(int level, const char *format, ...)
+#ifdef __GNUC__
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+
+    // Flushes and closes the file, a later line opens it again
+    static void close();
+
+private:
+    static std::atomic<int> current;
+    static thread_local int muted;
+    static const char *path;
+    static FILE *file;
 };
 
 #endif // LOGGER_H
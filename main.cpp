@@ -2,103 +2,678 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
 
 #include "chip8.h"
 #include "chip8gfx.h"
+#include "chip8term.h"
 #include "chip8audio.h"
+#include "chip8disasm.h"
+#include "chip8control.h"
+#include "chip8capture.h"
+#include "chip8native.h"
+#include "chip8frame.h"
+#include "chip8trace.h"
+#include "chip8shm.h"
+#include "chip8watch.h"
+#include "chip8rewind.h"
+#include "chip8alloc.h"
+#include "chip8quirks.h"
+#include "logger.h"
 
 Chip8    chip8;
-Chip8GFX gfx(&chip8);
+Chip8Display* display = nullptr; // stays null in headless runs
+bool audio = false;
+Chip8Disassembler disasm;
+Chip8ControlServer control(&chip8);
+Chip8Capture capture;
+Chip8Native native;
+Chip8Link coreLink; // emulation thread <-> render thread
+Chip8SharedMemory shm;
+Chip8RomWatch romWatch;
+bool reloadKeepsState = true;
+bool autoQuirks = false; // a reloaded ROM is analyzed again
+Chip8Rewind history;
+bool rewinding = false; // Backspace held, frames go backwards
+int runAheadFrames = 0;
 
 
 //Frequencies to run subsystems at
-static constexpr double CPU_HZ    = 500.0;  // ~500–1000 typical
-static constexpr double TIMER_HZ  = 60.0;
-static constexpr double FRAME_HZ  = 120.0;
+static constexpr double FRAME_HZ  = 60.0;   // emulated frames, the timers tick once per frame
 
 //Time steps
-static constexpr double CPU_DT    = 1.0 / CPU_HZ;
-static constexpr double TIMER_DT  = 1.0 / TIMER_HZ;
 static constexpr double FRAME_DT  = 1.0 / FRAME_HZ;
 
-int main(int argc, char* argv[])
+// Longest wall clock step the core catches up on, after a stall (suspend,
+// a debugger on the process) it carries on instead of racing
+static constexpr double MAX_DT    = 0.25;
+
+// For the trace's counter tracks, since the last sample
+static unsigned long instructionsRun = 0;
+static unsigned long framesDrawn = 0;
+
+// IPS and draw rate in wall clock time, about 4 samples a second
+static void traceCounters()
+{
+    if (!Chip8Trace::isActive()) return;
+
+    static long long last = chip8Now();
+    const long long now = chip8Now();
+    if (now - last < 250000000) return;
+
+    const double seconds = (now - last) / 1e9;
+    Chip8Trace::counter("IPS", instructionsRun / seconds);
+    Chip8Trace::counter("draws/s", framesDrawn / seconds);
+    instructionsRun = framesDrawn = 0;
+    last = now;
+}
+
+// What the renderer gets, with --run-ahead the machine runAheadFrames frames
+// on using the keys held now, so a press shows up that much sooner
+static void publishFrame(Chip8Frame &frame)
 {
-    if (argc != 2)
+    static double averageNs = 0.0;
+    static Chip8State present; // the machine as it is while runAhead looks at the future
+    if (runAheadFrames == 0 || chip8.isPaused() || rewinding)
     {
-        std::cout << "Usage: ./chip8 <gamePath>\n";
-        return 0;
+        chip8.saveFrame(frame);
+        frame.runAhead = 0;
     }
+    else
+    {
+        Chip8TraceSpan span("runAhead");
+        const long long start = chip8Now();
+        chip8.runAhead(runAheadFrames, frame, present); // not counted in IPS, it is thrown away
+        averageNs += (chip8Now() - start - averageNs) * 0.05;
+        frame.runAhead = runAheadFrames;
+    }
+    frame.runAheadNs = static_cast<long long>(averageNs);
+}
 
-    chip8.setGFX(&gfx);
+// Hands the renderer the newest frame, once after however many frames a
+// pass of the core caught up on; only the last would be seen, and with
+// --run-ahead each publish costs runAheadFrames more frames
+static bool publishDue = false;
+static void presentFrame()
+{
+    if (!publishDue) return;
+    publishDue = false;
+    Chip8TraceSpan span("publish");
+    publishFrame(coreLink.frames.back());
+    coreLink.frames.publish();
+}
 
-    while (true)
+// One 60Hz frame of emulated time: the instructions its cycle budget pays
+// for, then the beeper and the picture as they stand at its end, the picture
+// going out with presentFrame. The window and headless runs both go through
+// here, the wall clock only decides when.
+static void emulateFrame()
+{
+    if (rewinding)
     {
-        chip8.initialize();
-        beep_init();
+        // a frame back per frame, shown like any other
+        Chip8TraceSpan span("rewind");
+        if (history.rewind(chip8)) chip8.drawFlag = true;
+    }
+    else
+    {
+        {
+            Chip8TraceSpan span("runFrame");
+            instructionsRun += chip8.runFrame();
+        }
+        if (!chip8.isPaused())
+        {
+            Chip8TraceSpan span("record");
+            history.record(chip8);
+        }
+    }
 
-        if (!chip8.loadGame(argv[1]))
+    {
+        Chip8TraceSpan span("timers");
+        const bool beeping = !chip8.isPaused() && !rewinding && chip8.getSoundTimer() > 0;
+        if (audio)
         {
-            std::cerr << "Failed to load game!\n";
-            return 1;
+            // XO-CHIP programs load their own waveform, rewinds and restarts can change it too
+            static unsigned long audioVersion = 0;
+            if (chip8.getAudioVersion() != audioVersion)
+            {
+                audioVersion = chip8.getAudioVersion();
+                if (chip8.hasAudioPattern()) beep_set_pattern(chip8.getAudioPattern(), chip8.getPitch());
+                else beep_set_square();
+            }
+            beep_set_on(beeping);
         }
+        if (!chip8.isPaused())
+        {
+            capture.tick(beeping);
+        }
+    }
 
-        bool running = true;
-        bool restart = false;
+    // the heat map and a future picture can change without the display changing
+    const bool drawn = chip8.drawFlag;
+    if (display && (drawn || chip8.isHeatMapOn() || runAheadFrames > 0)) publishDue = true;
+    if (drawn)
+    {
+        ++framesDrawn;
+        capture.submitFrame(chip8.getDisplayBuffer()); // only queues a copy, the real frames
+        chip8.drawFlag = false;
+    }
+}
 
+// No window, no audio device, no wall clock: emulated time runs as fast as
+// the host allows until maxTicks frames have passed (0 = forever).
+static void runHeadless(unsigned long maxTicks)
+{
+    Chip8Trace::nameThread("core");
+    for (unsigned long tick = 0; maxTicks == 0 || tick < maxTicks; ++tick)
+    {
+        Chip8AllocCheck::frame("headless");
+        control.poll();
+        emulateFrame();
+        traceCounters();
+    }
+}
 
-        using clock = std::chrono::steady_clock;
-        auto last = clock::now();
-        double cpuAcc   = 0.0;
-        double timerAcc = 0.0;
-        double frameAcc = 0.0;
+// An external agent steps the emulator through shared memory (chip8shm.h),
+// nothing runs between its commands.
+static void runShared(const Chip8State &bootState)
+{
+    Chip8Trace::nameThread("core");
+    for (;;)
+    {
+        Chip8AllocCheck::frame("shm");
+        control.poll();
+        if (!shm.waitRequest(100))
+        {
+            continue;
+        }
 
-        while (running)
+        unsigned int framesRun = 0;
+        switch (shm.command())
         {
-            //Get time delta
-            auto now = clock::now();
-            double dt = std::chrono::duration<double>(now - last).count();
-            last = now;
+            case Chip8SharedMemory::RUN:
+                for (int k = 0; k < 16; ++k)
+                {
+                    chip8.setKey(k, (shm.keys() >> k) & 1);
+                }
+                for (; framesRun < shm.frames(); ++framesRun)
+                {
+                    emulateFrame();
+                }
+                break;
 
-            //Accumulate time delta
-            cpuAcc   += dt;
-            timerAcc += dt;
-            frameAcc += dt;
+            case Chip8SharedMemory::RESET:
+                // same seed every episode, the agent sees the same game
+                chip8.loadState(bootState);
+                chip8.drawFlag = true;
+                break;
 
-            // check events (updates keypad & may clear Fx0A wait)
-            chip8.handleEvents(running, restart);
-            if (!running) break;
+            case Chip8SharedMemory::QUIT:
+                shm.finish(chip8, 0);
+                return;
+        }
+        shm.finish(chip8, framesRun);
+    }
+}
 
-            // --- run CPU at fixed rate; emulateCycle should early-return if Fx0A waiting
-            while (cpuAcc >= CPU_DT) {
-                chip8.emulateCycle();
-                cpuAcc -= CPU_DT;
-            }
+// Keys and debugger commands from the renderer. A key released in the same
+// pass it was pressed in stays down until the next one, so a quick tap
+// still reaches the program.
+static void applyInput(const Chip8State &bootState, unsigned int &releaseLater)
+{
+    for (int k = 0; k < 16; ++k)
+    {
+        if (releaseLater >> k & 1) chip8.setKey(k, 0);
+    }
+    releaseLater = 0;
+
+    unsigned int pressedNow = 0;
+    Chip8Input input;
+    while (coreLink.input.pop(input))
+    {
+        switch (input.type)
+        {
+            case Chip8Input::KEY:
+                if (input.pressed)
+                {
+                    chip8.setKey(input.key, 1);
+                    chip8.traceKey(input.key, input.time);
+                    pressedNow |= 1u << input.key;
+                    releaseLater &= ~(1u << input.key);
+                }
+                else if (pressedNow >> input.key & 1)
+                    releaseLater |= 1u << input.key;
+                else
+                    chip8.setKey(input.key, 0);
+                break;
 
-           // timers driven by wall clock
-            while (timerAcc >= TIMER_DT) {
-                beep_set_on(false); //reset beeper
-                chip8.tickTimers(); // decrement delay/sound timers here
-                timerAcc -= TIMER_DT;
+            case Chip8Input::RESTART:
+            {
+                // fresh seed, so the restarted game doesn't replay the same random numbers
+                Chip8AllocCheck::Allow allow; // the analysis is rebuilt
+                chip8.loadState(bootState);
+                chip8.seedRandom(static_cast<unsigned int>(std::rand()));
+                chip8.drawFlag = true;
+                disasm.analyze(chip8.getMemory(), chip8.getBufferSize());
+                beep_set_on(false);
+                pressedNow = releaseLater = 0;
+                break;
             }
 
-            //render ~60 FPS
-            if (frameAcc >= FRAME_DT) {
-                if (chip8.drawFlag) {
-                    gfx.drawGraphics();
-                    chip8.drawFlag = false;
-                }
-                frameAcc -= FRAME_DT;
+            case Chip8Input::RUN_PAUSE:
+                if (chip8.isPaused()) chip8.resume();
+                else chip8.pause();
+                break;
+
+            case Chip8Input::BREAKPOINT:
+            {
+                Chip8AllocCheck::Allow allow;
+                const unsigned short pc = chip8.getPC();
+                if (chip8.hasBreakpoint(pc)) chip8.removeBreakpoints(pc);
+                else chip8.addBreakpoint(pc);
+                chip8.drawFlag = true;
+                break;
             }
 
-            //tiny yield
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            case Chip8Input::STEP_OVER:
+                chip8.stepOver();
+                break;
+
+            case Chip8Input::STEP:
+                chip8.step();
+                break;
+
+            case Chip8Input::HEAT_MAP:
+                chip8.setHeatMap(!chip8.isHeatMapOn());
+                break;
+
+            case Chip8Input::REWIND:
+                rewinding = input.pressed && history.isEnabled();
+                break;
+        }
+    }
+}
+
+// The profile this ROM was analyzed to need, worked out on its first launch
+static void detectQuirks(const unsigned char *rom, long size)
+{
+    const Chip8QuirkDetect::Result result =
+        Chip8QuirkDetect::detect(rom, size, chip8.isXOChip(), chip8.getTiming());
+    chip8.setQuirks(result.quirks);
+
+    if (result.cached)
+    {
+        std::cout << "Quirks: " << result.quirks.name() << " (cached)" << std::endl;
+        return;
+    }
+    std::cout << "Quirks: " << result.quirks.name() << " (" << result.outcomes
+              << (result.outcomes == 1 ? " outcome" : " outcomes") << " across "
+              << Chip8Quirks::COUNT << " profiles in " << static_cast<int>(result.seconds * 1000) << " ms";
+    if (!result.reason.empty()) std::cout << ", default " << result.reason;
+    std::cout << ")" << std::endl;
+}
+
+// The ROM file was rebuilt, swap it in without touching the window
+static void reloadROM(Chip8State &bootState)
+{
+    Chip8AllocCheck::Allow allow;
+    std::vector<unsigned char> rom;
+    if (!romWatch.read(rom) ||
+        !chip8.reloadROM(rom.data(), static_cast<long>(rom.size()), bootState.memory + 0x200, reloadKeepsState))
+    {
+        std::cerr << "ROM reload failed, still running the old one\n";
+        return;
+    }
+
+    // ESC restarts the new build from now on
+    memset(bootState.memory + 0x200, 0, bootState.memorySize - 0x200);
+    memcpy(bootState.memory + 0x200, rom.data(), rom.size());
+
+    if (autoQuirks) detectQuirks(rom.data(), static_cast<long>(rom.size()));
+    disasm.analyze(chip8.getMemory(), chip8.getBufferSize());
+    history.clear(); // older frames would put the old code back
+    if (!reloadKeepsState) beep_set_on(false);
+    std::cout << "Reloaded " << rom.size() << " bytes" << (reloadKeepsState ? "" : ", reset") << std::endl;
+}
+
+// Emulation thread, the only one touching chip8, the control socket and the
+// capture. It keeps its own clock, a renderer blocked in vsync or held up
+// by the compositor only costs frames, never emulated time.
+static void runCore(Chip8State &bootState)
+{
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    double frameAcc = 0.0;
+    unsigned int releaseLater = 0;
+    Chip8Trace::nameThread("core");
+
+    while (coreLink.running.load(std::memory_order_relaxed))
+    {
+        Chip8AllocCheck::frame("core");
+
+        //Get time delta
+        auto now = clock::now();
+        double dt = std::min(std::chrono::duration<double>(now - last).count(), MAX_DT);
+        last = now;
+
+        //Accumulate time delta
+        frameAcc += dt;
+
+        // keypad (may clear Fx0A wait), debugger and restart
+        applyInput(bootState, releaseLater);
+
+        // --watch, the ROM was rebuilt
+        if (romWatch.changed()) reloadROM(bootState);
+
+        // requests from control clients
+        control.poll();
+
+        // whole frames of emulated time as they fall due, input lands between
+        // frames; runFrame stops early at breakpoints and does nothing while paused
+        while (frameAcc >= FRAME_DT) {
+            emulateFrame();
+            frameAcc -= FRAME_DT;
         }
+        presentFrame();
+        traceCounters();
+
+        //tiny yield
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Run the ROM through a chip8c shared object, after it has been loaded
+static bool attachNative(const char* path)
+{
+    if (!native.load(path))
+    {
+        return false;
+    }
+    if (!native.matches(chip8.getMemory()))
+    {
+        std::cerr << path << " was compiled from a different ROM, interpreting instead\n";
+    }
+    chip8.setNative(&native);
+    return true;
+}
 
-        gfx.cleanUp();
+int main(int argc, char* argv[])
+{
+    const char* gamePath = nullptr;
+    const char* controlPath = nullptr;
+    const char* recordPath = nullptr;
+    const char* palette = nullptr;
+    const char* nativePath = nullptr;
+    const char* tracePath = nullptr;
+    const char* shmName = nullptr;
+    const char* watchMode = nullptr;
+    bool headless = false;
+    bool terminal = false;
+    bool fullscreen = false;
+    bool debug = false;
+    bool xoChip = false;
+    const char* quirksMode = nullptr;
+    Chip8Quirks quirks;
+    unsigned long maxTicks = 0;
+    Chip8Timing timing = Chip8Timing::flat(Chip8::DEFAULT_CLOCK_RATE);
+    unsigned int cyclesPerFrame = 0;
+    unsigned long rewindMB = 16;
 
-        if (!restart)
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--control" && i + 1 < argc)
+            controlPath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--ticks" && i + 1 < argc)
+            maxTicks = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--native" && i + 1 < argc)
+            nativePath = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (arg == "--shm" && i + 1 < argc)
+            shmName = argv[++i];
+        else if (arg == "--watch" && i + 1 < argc)
+            watchMode = argv[++i];
+        else if (arg == "--palette" && i + 1 < argc)
+            palette = argv[++i];
+        else if (arg == "--log-level" && i + 1 < argc)
+        {
+            if (!Logger::setLevel(argv[++i]))
+            {
+                std::cerr << "Unknown log level, use trace, debug, info, warn or off\n";
+                return 1;
+            }
+        }
+        else if (arg == "--timing" && i + 1 < argc)
+        {
+            const std::string name(argv[++i]);
+            if (name == "vip") timing = Chip8Timing::vip();
+            else if (name != "flat")
+            {
+                std::cerr << "Unknown timing, use flat or vip\n";
+                return 1;
+            }
+        }
+        else if (arg == "--run-ahead" && i + 1 < argc)
+        {
+            runAheadFrames = std::atoi(argv[++i]);
+            if (runAheadFrames < 0 || runAheadFrames > 8)
+            {
+                std::cerr << "--run-ahead takes 0 to 8 frames\n";
+                return 1;
+            }
+        }
+        else if (arg == "--rewind" && i + 1 < argc)
+            rewindMB = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--cycles-per-frame" && i + 1 < argc)
+            cyclesPerFrame = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--fullscreen")
+            fullscreen = true;
+        else if (arg == "--debug")
+            debug = true;
+        else if (arg == "--xo-chip")
+            xoChip = true;
+        else if (arg == "--quirks" && i + 1 < argc)
+        {
+            quirksMode = argv[++i];
+            if (strcmp(quirksMode, "auto") != 0 && !Chip8Quirks::parse(quirksMode, quirks))
+            {
+                std::cerr << "Unknown quirks, use auto, none, vip or a comma list of inc-i, shift-vy, vf-reset and wrap\n";
+                return 1;
+            }
+        }
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--term")
+            terminal = true;
+        else if (!gamePath)
+            gamePath = argv[i];
+        else
+        {
+            gamePath = nullptr; // too many arguments
             break;
+        }
+    }
+
+    if (!gamePath)
+    {
+        std::cout << "Usage: ./chip8 [--control <socketPath>] [--record <basePath>] [--native <rom.so>] [--trace <trace.json>] [--palette <name|RRGGBB,RRGGBB>] [--timing <flat|vip>] [--cycles-per-frame <n>] [--rewind <MB>] [--run-ahead <n>] [--fullscreen] [--debug] [--log-level <trace|debug|info|warn|off>] [--xo-chip] [--quirks <auto|none|vip|inc-i,shift-vy,vf-reset,wrap>] [--term] [--watch <keep|reset>] [--headless [--ticks <n> | --shm <name>]] <gamePath>\n";
+        return 0;
     }
 
+    // stdio would allocate this on the first print, which can be deep into a game
+    static char stdoutBuffer[BUFSIZ];
+    setvbuf(stdout, stdoutBuffer, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, sizeof(stdoutBuffer));
+
+    // written at exit, or with F8
+    if (tracePath && !Chip8Trace::start(tracePath))
+    {
+        return 1;
+    }
+
+    // scripts drive the emulator through this socket
+    if (controlPath && !control.open(controlPath))
+    {
+        return 1;
+    }
+
+    chip8.setDisassembler(&disasm);
+    chip8.setTiming(cyclesPerFrame ? timing.withCyclesPerFrame(cyclesPerFrame) : timing);
+
+    // .xo8 is the XO-CHIP extension, anything else runs as plain CHIP-8 unless asked
+    const size_t pathLength = strlen(gamePath);
+    if (pathLength > 4 && strcmp(gamePath + pathLength - 4, ".xo8") == 0)
+        xoChip = true;
+    chip8.setXOChip(xoChip);
+    disasm.setXOChip(xoChip);
+
+    // picked per ROM unless given, headless runs stay on the default for scripts
+    autoQuirks = quirksMode ? strcmp(quirksMode, "auto") == 0 : !headless;
+    chip8.setQuirks(quirks);
+    control.setAutoQuirks(autoQuirks);
+
+    if (headless)
+    {
+        chip8.initialize();
+        if (!chip8.loadGame(gamePath))
+        {
+            std::cerr << "Failed to load game!\n";
+            return 1;
+        }
+        if (autoQuirks) detectQuirks(chip8.getMemory() + 0x200, chip8.getBufferSize());
+        disasm.analyze(chip8.getMemory(), chip8.getBufferSize());
+
+        if (nativePath && !attachNative(nativePath))
+        {
+            return 1;
+        }
+        if (recordPath && !capture.start(recordPath, true))
+        {
+            return 1;
+        }
+
+        if (shmName)
+        {
+            Chip8State bootState;
+            chip8.saveState(bootState);
+            control.setHost(&bootState, nullptr);
+            if (!shm.open(shmName))
+            {
+                return 1;
+            }
+            runShared(bootState);
+            shm.close();
+        }
+        else
+        {
+            runHeadless(maxTicks);
+        }
+        capture.stop();
+        Chip8Trace::write();
+        return 0;
+    }
+
+    chip8.initialize();
+
+    if (!chip8.loadGame(gamePath))
+    {
+        std::cerr << "Failed to load game!\n";
+        return 1;
+    }
+    // before the window opens, it would sit there frozen while the profiles run
+    if (autoQuirks) detectQuirks(chip8.getMemory() + 0x200, chip8.getBufferSize());
+
+    // the terminal display is created last, so errors before it stay readable
+    if (!terminal)
+    {
+        Chip8GFX *window = new Chip8GFX();
+        display = window;
+        if (palette && !window->setPalette(palette))
+        {
+            std::cerr << "Unknown palette, use one of " << Chip8GFX::paletteNames() << " or RRGGBB,RRGGBB[,RRGGBB,RRGGBB] (on,off[,plane 2,both])\n";
+            return 1;
+        }
+        if (fullscreen)
+            window->toggleFullscreen();
+        if (debug)
+            window->toggleDebugWindow();
+        audio = beep_init();
+    }
+
+    // find code vs data once, the debugger listing is built from this
+    disasm.analyze(chip8.getMemory(), chip8.getBufferSize());
+
+    if (nativePath && !attachNative(nativePath))
+    {
+        return 1;
+    }
+
+    // ESC restores this instead of reloading anything, SDL, TTF and audio stay up
+    Chip8State bootState;
+    chip8.saveState(bootState);
+    control.setHost(&bootState, &history);
+
+    // hot reload when the ROM is rebuilt
+    if (watchMode)
+    {
+        if (strcmp(watchMode, "keep") != 0 && strcmp(watchMode, "reset") != 0)
+        {
+            std::cerr << "--watch takes keep (registers and display stay) or reset\n";
+            return 1;
+        }
+        reloadKeepsState = strcmp(watchMode, "keep") == 0;
+        if (!romWatch.open(gamePath))
+        {
+            return 1;
+        }
+    }
+
+    // one recording covers every restart
+    if (recordPath && !capture.start(recordPath))
+    {
+        return 1;
+    }
+
+    // hold Backspace to go back, minutes of frames in rewindMB (0 = off)
+    history.setCapacity(rewindMB << 20);
+
+    // takes over the screen; no sound, palette, full screen or debugger, those are window only
+    if (terminal)
+        display = new Chip8Terminal();
+
+    // from here on chip8 belongs to the core thread
+    chip8.drawFlag = true;
+    std::thread core([&bootState] { runCore(bootState); });
+    Chip8Trace::nameThread("render");
+
+    // render thread: events and presenting, only ever reads published frames
+    while (coreLink.running.load(std::memory_order_relaxed))
+    {
+        Chip8AllocCheck::frame("render");
+        display->handleEvents(coreLink);
+
+        if (coreLink.frames.update() || display->needsRedraw())
+            display->drawGraphics(coreLink.frames.front());
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    core.join();
+    Chip8Trace::write();
+
+    capture.stop();
+    if (audio) beep_shutdown();
+
+    // after the terminal display has given the screen back
+    display->cleanUp();
+    display->getLatency().report(stdout);
+    delete display;
+
     return 0;
 }